@@ -0,0 +1,54 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Builds the engine benchmarks with the same flags as the render build.
+
+cd "$(dirname "$0")/.."
+mkdir -p build
+
+CC="${CC:-cc}"
+CFLAGS="${CFLAGS:-}"
+
+"$CC" -std=c11 -O2 -ffp-contract=off -D_DEFAULT_SOURCE $CFLAGS -Isrc \
+  -o build/jamal-bench \
+  bench/voice_bench.c \
+  src/engine_core.c \
+  src/voice.c \
+  src/voice_alloc.c \
+  src/delay_pool.c \
+  src/control_ring.c \
+  src/meter_ring.c \
+  src/render_pool.c \
+  src/dsp_math.c \
+  src/dsl.c \
+  -lm -pthread
+
+"$CC" -std=c11 -O2 -ffp-contract=off -D_DEFAULT_SOURCE $CFLAGS -Isrc \
+  -o build/jamal-scale \
+  bench/scale_bench.c \
+  src/engine_core.c \
+  src/voice.c \
+  src/voice_alloc.c \
+  src/delay_pool.c \
+  src/control_ring.c \
+  src/meter_ring.c \
+  src/render_pool.c \
+  src/dsp_math.c \
+  src/dsl.c \
+  -lm -pthread
+
+"$CC" -std=c11 -O2 -ffp-contract=off -D_DEFAULT_SOURCE $CFLAGS -Isrc \
+  -o build/jamal-suite \
+  bench/golden_bench.c \
+  src/engine_core.c \
+  src/voice.c \
+  src/voice_alloc.c \
+  src/delay_pool.c \
+  src/control_ring.c \
+  src/meter_ring.c \
+  src/render_pool.c \
+  src/dsp_math.c \
+  src/dsl.c \
+  -lm -pthread
+
+echo "Built build/jamal-bench, build/jamal-scale and build/jamal-suite"
@@ -0,0 +1,570 @@
+#include "engine_core.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// End-to-end render benchmark and golden-output check. Renders every script
+// in the examples directory at fixed settings (48 kHz, 256-frame blocks as
+// an audio callback would ask for, one render thread) and reports speed
+// against realtime, per-block time percentiles and peak RSS. Each script
+// renders in its own child process, so the RSS is that script's alone.
+// Each output is hashed and compared with the golden file:
+//
+//   match    same hash: bit-identical output
+//   drift    different hash, but RMS and peak per channel within the relative
+//            tolerance: a rounding-level change
+//   changed  anything else: the sound changed
+//
+//   jamal-suite [--examples dir] [--golden file] [--seconds s]
+//               [--tolerance rel] [--json file|-] [--update-golden]
+//
+// Defaults: examples/, bench/golden.txt, 20 seconds, tolerance 1e-4. A
+// golden file written with other settings or another ENGINE_RENDER_VERSION
+// isn't compared against. --update-golden rewrites it from this run. A last
+// check reloads a script after an amp control and expects its drone back at
+// the script's level. The exit status is 1 if a script failed to render or
+// changed, or that check failed.
+//
+// The hash is FNV-1a over the interleaved float samples, so it also matches
+// the data of `jamal-render --render <script> out.wav <seconds>`.
+
+#define SUITE_SAMPLE_RATE 48000
+#define SUITE_BUFFER_FRAMES 256
+#define SUITE_MAX_SCRIPTS 256
+#define SUITE_NAME 128
+
+typedef enum {
+    GOLDEN_UNCHECKED, // no golden entry to compare with
+    GOLDEN_MATCH,
+    GOLDEN_DRIFT,
+    GOLDEN_CHANGED,
+    GOLDEN_ERROR // the script failed to render
+} GoldenStatus;
+
+static const char *status_names[] = {"unchecked", "match", "drift", "changed", "error"};
+
+typedef struct {
+    char name[SUITE_NAME];
+    uint64_t hash;
+    long long frames;
+    double rms[2];
+    double peak[2];
+} Golden;
+
+typedef struct {
+    Golden out;
+    GoldenStatus status;
+    double elapsed;
+    double block_us[5]; // p50, p90, p99, p99.9, max
+    long peak_rss_kb;
+    char error[256];
+} ScriptResult;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static long rss_kb(const struct rusage *usage) {
+#ifdef __APPLE__
+    return usage->ru_maxrss / 1024; // bytes on macOS
+#else
+    return usage->ru_maxrss;
+#endif
+}
+
+static char *read_text_file(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+    char *text = (char *)malloc((size_t)(size > 0 ? size : 0) + 1);
+    if (!text) {
+        fclose(file);
+        return NULL;
+    }
+    size_t len = fread(text, 1, (size_t)(size > 0 ? size : 0), file);
+    fclose(file);
+    text[len] = '\0';
+    return text;
+}
+
+static int compare_strings(const void *a, const void *b) {
+    return strcmp((const char *)a, (const char *)b);
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Script names (file names without .jamal) in the directory, sorted.
+static int list_scripts(const char *dir_path, char names[][SUITE_NAME], int max) {
+    DIR *dir = opendir(dir_path);
+    if (!dir) {
+        return -1;
+    }
+    int count = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL && count < max) {
+        size_t len = strlen(ent->d_name);
+        if (len > 6 && len - 6 < SUITE_NAME && strcmp(ent->d_name + len - 6, ".jamal") == 0) {
+            memcpy(names[count], ent->d_name, len - 6);
+            names[count][len - 6] = '\0';
+            count++;
+        }
+    }
+    closedir(dir);
+    qsort(names, (size_t)count, SUITE_NAME, compare_strings);
+    return count;
+}
+
+static int render_script(const char *dir, const char *name, double seconds, ScriptResult *result) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s.jamal", dir, name);
+    snprintf(result->out.name, sizeof(result->out.name), "%s", name);
+    char *text = read_text_file(path);
+    if (!text) {
+        snprintf(result->error, sizeof(result->error), "%s", strerror(errno));
+        return 0;
+    }
+
+    Program *program = (Program *)malloc(sizeof(Program));
+    EngineState *engine = (EngineState *)malloc(sizeof(EngineState));
+    float *out = (float *)malloc(sizeof(float) * 2 * SUITE_BUFFER_FRAMES);
+    long long total = (long long)(seconds * SUITE_SAMPLE_RATE);
+    long long blocks = (total + SUITE_BUFFER_FRAMES - 1) / SUITE_BUFFER_FRAMES;
+    double *block_times = (double *)malloc(sizeof(double) * (size_t)(blocks > 0 ? blocks : 1));
+    int ok = program && engine && out && block_times;
+    if (!ok) {
+        snprintf(result->error, sizeof(result->error), "Out of memory");
+    }
+    if (ok) {
+        ok = dsl_parse_script(text, program, result->error, sizeof(result->error));
+    }
+    if (ok) {
+        engine_init(engine);
+        engine->sample_rate = SUITE_SAMPLE_RATE;
+        engine->buffer_frames = SUITE_BUFFER_FRAMES;
+        ok = engine_set_voice_count(engine, program->voice_count, result->error, sizeof(result->error)) &&
+             engine_load_program(engine, program, result->error, sizeof(result->error));
+        if (ok) {
+            uint64_t hash = 0xcbf29ce484222325ull;
+            double sum[2] = {0.0, 0.0};
+            double peak[2] = {0.0, 0.0};
+            result->elapsed = 0.0;
+            long long block = 0;
+            for (long long done = 0; done < total; done += SUITE_BUFFER_FRAMES) {
+                int n = (total - done < SUITE_BUFFER_FRAMES) ? (int)(total - done) : SUITE_BUFFER_FRAMES;
+                double start = now_seconds();
+                engine_render(engine, out, out + 1, 2, n);
+                double took = now_seconds() - start;
+                result->elapsed += took;
+                block_times[block++] = took * 1e6;
+                const unsigned char *bytes = (const unsigned char *)out;
+                for (size_t i = 0; i < sizeof(float) * 2 * (size_t)n; i++) {
+                    hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+                }
+                for (int i = 0; i < 2 * n; i++) {
+                    double x = out[i];
+                    sum[i & 1] += x * x;
+                    if (fabs(x) > peak[i & 1]) {
+                        peak[i & 1] = fabs(x);
+                    }
+                }
+            }
+            result->out.hash = hash;
+            result->out.frames = total;
+            for (int c = 0; c < 2; c++) {
+                result->out.rms[c] = total > 0 ? sqrt(sum[c] / (double)total) : 0.0;
+                result->out.peak[c] = peak[c];
+            }
+            qsort(block_times, (size_t)block, sizeof(double), compare_doubles);
+            if (block > 0) {
+                result->block_us[0] = block_times[block / 2];
+                result->block_us[1] = block_times[block * 9 / 10];
+                result->block_us[2] = block_times[block * 99 / 100];
+                result->block_us[3] = block_times[block * 999 / 1000];
+                result->block_us[4] = block_times[block - 1];
+            }
+        }
+        engine_free(engine);
+    }
+    free(text);
+    free(program);
+    free(engine);
+    free(out);
+    free(block_times);
+    return ok;
+}
+
+// Runs render_script in a forked child, so the child's peak RSS, taken from
+// wait4, belongs to this script alone. RUSAGE_SELF or RUSAGE_CHILDREN would
+// report the high-water mark of every script so far. A script that crashes
+// the renderer fails without taking the suite down.
+static int render_isolated(const char *dir, const char *name, double seconds, ScriptResult *result) {
+    memset(result, 0, sizeof(*result));
+    snprintf(result->out.name, sizeof(result->out.name), "%s", name);
+    int fds[2];
+    if (pipe(fds) != 0) {
+        snprintf(result->error, sizeof(result->error), "pipe: %s", strerror(errno));
+        return 0;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        snprintf(result->error, sizeof(result->error), "fork: %s", strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        return 0;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        ScriptResult child;
+        memset(&child, 0, sizeof(child));
+        child.status = render_script(dir, name, seconds, &child) ? GOLDEN_UNCHECKED : GOLDEN_ERROR;
+        const char *p = (const char *)&child;
+        size_t left = sizeof(child);
+        while (left > 0) {
+            ssize_t n = write(fds[1], p, left);
+            if (n <= 0) {
+                _exit(1);
+            }
+            p += n;
+            left -= (size_t)n;
+        }
+        _exit(0);
+    }
+
+    close(fds[1]);
+    ScriptResult child;
+    char *p = (char *)&child;
+    size_t got = 0;
+    while (got < sizeof(child)) {
+        ssize_t n = read(fds[0], p + got, sizeof(child) - got);
+        if (n <= 0) {
+            break;
+        }
+        got += (size_t)n;
+    }
+    close(fds[0]);
+    int status = 0;
+    struct rusage usage;
+    memset(&usage, 0, sizeof(usage));
+    if (wait4(pid, &status, 0, &usage) < 0 || got != sizeof(child) || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        snprintf(result->error, sizeof(result->error), "renderer exited abnormally");
+        return 0;
+    }
+    *result = child;
+    result->peak_rss_kb = rss_kb(&usage);
+    return result->status != GOLDEN_ERROR;
+}
+
+static int within(double value, double golden, double tolerance) {
+    return fabs(value - golden) <= tolerance * fabs(golden) + 1e-9;
+}
+
+static GoldenStatus check_golden(const Golden *out, const Golden *golden, int golden_count, double tolerance) {
+    for (int i = 0; i < golden_count; i++) {
+        const Golden *g = &golden[i];
+        if (strcmp(g->name, out->name) != 0) {
+            continue;
+        }
+        if (g->hash == out->hash && g->frames == out->frames) {
+            return GOLDEN_MATCH;
+        }
+        int close = g->frames == out->frames;
+        for (int c = 0; c < 2; c++) {
+            close &= within(out->rms[c], g->rms[c], tolerance) && within(out->peak[c], g->peak[c], tolerance);
+        }
+        return close ? GOLDEN_DRIFT : GOLDEN_CHANGED;
+    }
+    return GOLDEN_UNCHECKED;
+}
+
+// Reads the golden file. Returns the entry count, 0 if the file is missing
+// or was written with other settings.
+static int read_golden(const char *path, double seconds, Golden *golden, int max) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return 0;
+    }
+    char line[512];
+    int count = 0;
+    int settings_ok = 0;
+    while (fgets(line, sizeof(line), file) && count < max) {
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        double s;
+        int rate, frames, version;
+        if (sscanf(line, "settings %lf %d %d %d", &s, &rate, &frames, &version) == 4) {
+            settings_ok = s == seconds && rate == SUITE_SAMPLE_RATE && frames == SUITE_BUFFER_FRAMES &&
+                          version == ENGINE_RENDER_VERSION;
+            if (!settings_ok) {
+                fprintf(stderr, "%s was written with other settings or engine version; not comparing\n", path);
+                break;
+            }
+            continue;
+        }
+        Golden *g = &golden[count];
+        unsigned long long hash;
+        if (sscanf(line, "%127s %llx %lld %lf %lf %lf %lf", g->name, &hash, &g->frames, &g->rms[0], &g->rms[1],
+                   &g->peak[0], &g->peak[1]) == 7) {
+            g->hash = hash;
+            count++;
+        }
+    }
+    fclose(file);
+    return settings_ok ? count : 0;
+}
+
+static int write_golden(const char *path, double seconds, const ScriptResult *results, int count) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        return 0;
+    }
+    fprintf(file, "# Golden outputs of examples/, written by jamal-suite --update-golden.\n");
+    fprintf(file, "# settings <seconds> <sample_rate> <buffer_frames> <ENGINE_RENDER_VERSION>\n");
+    fprintf(file, "# <script> <fnv1a64> <frames> <rms_l> <rms_r> <peak_l> <peak_r>\n");
+    fprintf(file, "settings %g %d %d %d\n", seconds, SUITE_SAMPLE_RATE, SUITE_BUFFER_FRAMES, ENGINE_RENDER_VERSION);
+    for (int i = 0; i < count; i++) {
+        const Golden *g = &results[i].out;
+        if (results[i].status == GOLDEN_ERROR) {
+            continue;
+        }
+        fprintf(file, "%s %016llx %lld %.9g %.9g %.9g %.9g\n", g->name, (unsigned long long)g->hash, g->frames, g->rms[0],
+                g->rms[1], g->peak[0], g->peak[1]);
+    }
+    return fclose(file) == 0;
+}
+
+// Script names are file names; escape what JSON requires.
+static void json_string(FILE *file, const char *s) {
+    fputc('"', file);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            fprintf(file, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(file, "\\u%04x", c);
+        } else {
+            fputc(c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+static void write_json(FILE *file, double seconds, const ScriptResult *results, int count) {
+    double audio = 0.0;
+    double elapsed = 0.0;
+    long peak_rss = 0;
+    int failed = 0;
+    fprintf(file, "{\n  \"engine_render_version\": %d,\n", ENGINE_RENDER_VERSION);
+    fprintf(file, "  \"settings\": {\"seconds\": %g, \"sample_rate\": %d, \"buffer_frames\": %d},\n", seconds,
+            SUITE_SAMPLE_RATE, SUITE_BUFFER_FRAMES);
+    fprintf(file, "  \"scripts\": [");
+    for (int i = 0; i < count; i++) {
+        const ScriptResult *r = &results[i];
+        fprintf(file, "%s\n    {\"name\": ", i ? "," : "");
+        json_string(file, r->out.name);
+        fprintf(file, ", \"golden\": \"%s\"", status_names[r->status]);
+        if (r->status == GOLDEN_ERROR) {
+            fprintf(file, ", \"error\": ");
+            json_string(file, r->error);
+            fprintf(file, "}");
+            failed++;
+            continue;
+        }
+        failed += r->status == GOLDEN_CHANGED;
+        audio += seconds;
+        elapsed += r->elapsed;
+        if (r->peak_rss_kb > peak_rss) {
+            peak_rss = r->peak_rss_kb;
+        }
+        fprintf(file, ", \"x_realtime\": %.2f, \"peak_rss_kb\": %ld,\n", seconds / r->elapsed, r->peak_rss_kb);
+        fprintf(file, "     \"block_us\": {\"p50\": %.2f, \"p90\": %.2f, \"p99\": %.2f, \"p99_9\": %.2f, \"max\": %.2f},\n",
+                r->block_us[0], r->block_us[1], r->block_us[2], r->block_us[3], r->block_us[4]);
+        fprintf(file, "     \"hash\": \"%016llx\", \"frames\": %lld, \"rms\": [%.9g, %.9g], \"peak\": [%.9g, %.9g]}",
+                (unsigned long long)r->out.hash, r->out.frames, r->out.rms[0], r->out.rms[1], r->out.peak[0],
+                r->out.peak[1]);
+    }
+    fprintf(file, "\n  ],\n");
+    fprintf(file, "  \"total\": {\"x_realtime\": %.2f, \"peak_rss_kb\": %ld, \"failed\": %d}\n}\n",
+            elapsed > 0.0 ? audio / elapsed : 0.0, peak_rss, failed);
+}
+
+// Stereo RMS of `seconds` of the engine's output.
+static double render_rms(EngineState *engine, double seconds) {
+    float out[2 * SUITE_BUFFER_FRAMES];
+    long long total = (long long)(seconds * SUITE_SAMPLE_RATE);
+    double sum = 0.0;
+    for (long long done = 0; done < total; done += SUITE_BUFFER_FRAMES) {
+        int n = (total - done < SUITE_BUFFER_FRAMES) ? (int)(total - done) : SUITE_BUFFER_FRAMES;
+        engine_render(engine, out, out + 1, 2, n);
+        for (int i = 0; i < 2 * n; i++) {
+            sum += (double)out[i] * out[i];
+        }
+    }
+    return total > 0 ? sqrt(sum / (double)(2 * total)) : 0.0;
+}
+
+// Param controls last until the next program takes over: after an amp
+// control, reloading the unchanged script must bring its drone back to the
+// script's level. Returns 1 if it does.
+static int check_reload_after_control(char *error, size_t error_len) {
+    static const char *script = "synth pad sine\n"
+                                "set pad amp 0.5\n"
+                                "set pad atk 0.01\n"
+                                "set pad sus 1\n"
+                                "drone pad 48\n"
+                                "pattern rest (. . . .)\n"
+                                "play rest pad\n";
+    Program *program = (Program *)malloc(sizeof(Program));
+    EngineState *engine = (EngineState *)malloc(sizeof(EngineState));
+    if (!program || !engine) {
+        free(program);
+        free(engine);
+        snprintf(error, error_len, "Out of memory");
+        return 0;
+    }
+    int ok = dsl_parse_script(script, program, error, error_len);
+    if (ok) {
+        engine_init(engine);
+        engine->sample_rate = SUITE_SAMPLE_RATE;
+        engine->buffer_frames = SUITE_BUFFER_FRAMES;
+        ok = engine_set_voice_count(engine, program->voice_count, error, error_len) &&
+             engine_load_program(engine, program, error, error_len);
+        if (ok) {
+            double before = render_rms(engine, 0.5);
+            ControlCommand cmd = {.type = CONTROL_PARAM, .param = SYNTH_PARAM_AMP, .value = 0.05f};
+            snprintf(cmd.synth, sizeof(cmd.synth), "pad");
+            engine_send_control(engine, &cmd);
+            double controlled = render_rms(engine, 0.5);
+            EngineProgram *prog = engine_compile_program(engine, program, error, error_len);
+            ok = prog != NULL;
+            if (ok) {
+                engine_submit_program(engine, prog);
+                render_rms(engine, 0.1); // the old drone fades, the new one attacks
+                double after = render_rms(engine, 0.5);
+                ok = controlled < 0.5 * before && within(after, before, 0.05);
+                if (!ok) {
+                    snprintf(error, error_len, "drone RMS %.4f, %.4f after the control, %.4f after the reload", before,
+                             controlled, after);
+                }
+            }
+            engine_collect_programs(engine);
+        }
+        engine_free(engine);
+    }
+    free(program);
+    free(engine);
+    return ok;
+}
+
+int main(int argc, const char *argv[]) {
+    const char *examples = "examples";
+    const char *golden_path = "bench/golden.txt";
+    const char *json_path = NULL;
+    double seconds = 20.0;
+    double tolerance = 1e-4;
+    int update = 0;
+    for (int i = 1; i < argc; i++) {
+        int has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--examples") == 0 && has_value) {
+            examples = argv[++i];
+        } else if (strcmp(argv[i], "--golden") == 0 && has_value) {
+            golden_path = argv[++i];
+        } else if (strcmp(argv[i], "--seconds") == 0 && has_value) {
+            seconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--tolerance") == 0 && has_value) {
+            tolerance = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--json") == 0 && has_value) {
+            json_path = argv[++i];
+        } else if (strcmp(argv[i], "--update-golden") == 0) {
+            update = 1;
+        } else {
+            fprintf(stderr,
+                    "usage: %s [--examples dir] [--golden file] [--seconds s] [--tolerance rel] [--json file|-] "
+                    "[--update-golden]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    if (!(seconds > 0.0)) {
+        seconds = 20.0;
+    }
+
+    static char names[SUITE_MAX_SCRIPTS][SUITE_NAME];
+    static Golden golden[SUITE_MAX_SCRIPTS];
+    static ScriptResult results[SUITE_MAX_SCRIPTS];
+    int count = list_scripts(examples, names, SUITE_MAX_SCRIPTS);
+    if (count < 0) {
+        fprintf(stderr, "%s: %s\n", examples, strerror(errno));
+        return 1;
+    }
+    int golden_count = update ? 0 : read_golden(golden_path, seconds, golden, SUITE_MAX_SCRIPTS);
+
+    // With JSON on stdout the table goes to stderr.
+    FILE *table = (json_path && strcmp(json_path, "-") == 0) ? stderr : stdout;
+    fprintf(table, "%d scripts, %.1f s each at %d Hz in %d-frame blocks\n", count, seconds, SUITE_SAMPLE_RATE,
+            SUITE_BUFFER_FRAMES);
+    fprintf(table, "%-22s %10s %9s %9s %9s %10s  %s\n", "script", "x-realtime", "p50 us", "p99 us", "max us", "peak RSS",
+            "golden");
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        ScriptResult *r = &results[i];
+        if (!render_isolated(examples, names[i], seconds, r)) {
+            r->status = GOLDEN_ERROR;
+            fprintf(table, "%-22s error: %s\n", names[i], r->error);
+            failed++;
+            continue;
+        }
+        r->status = check_golden(&r->out, golden, golden_count, tolerance);
+        failed += r->status == GOLDEN_CHANGED;
+        fprintf(table, "%-22s %10.1f %9.1f %9.1f %9.1f %7ld KB  %s\n", names[i], seconds / r->elapsed, r->block_us[0],
+                r->block_us[2], r->block_us[4], r->peak_rss_kb, status_names[r->status]);
+    }
+
+    char reload_error[256] = {0};
+    if (check_reload_after_control(reload_error, sizeof(reload_error))) {
+        fprintf(table, "%-22s ok\n", "reload after control");
+    } else {
+        fprintf(table, "%-22s FAILED: %s\n", "reload after control", reload_error);
+        failed++;
+    }
+
+    if (json_path) {
+        FILE *file = strcmp(json_path, "-") == 0 ? stdout : fopen(json_path, "w");
+        if (!file) {
+            fprintf(stderr, "%s: %s\n", json_path, strerror(errno));
+            return 1;
+        }
+        write_json(file, seconds, results, count);
+        if (file != stdout) {
+            fclose(file);
+        }
+    }
+    if (update) {
+        if (!write_golden(golden_path, seconds, results, count)) {
+            fprintf(stderr, "%s: %s\n", golden_path, strerror(errno));
+            return 1;
+        }
+        fprintf(table, "Wrote %s\n", golden_path);
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,181 @@
+#include "engine_core.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Render-thread scaling benchmark. Renders a script with 1 to max_threads
+// render threads, in live mode (256-frame blocks, as an audio callback would
+// ask for) and render mode (4096-frame blocks, as an offline render writes),
+// and reports speed against realtime and against one thread. Every run's
+// output is hashed and must match the single-thread run.
+//
+//   jamal-scale [script.jamal|-] [seconds] [max_threads]
+//
+// Defaults: `-`, a built-in dense script of unbankable voices, 20 seconds of
+// audio at 48 kHz, up to 16 threads. The slowest block is reported too; in
+// live mode it has 5.3 ms to finish.
+
+#define LIVE_FRAMES 256
+#define RENDER_FRAMES 4096
+
+// Comb, PM and supersaw voices render one job each; long releases keep
+// around a hundred of them sounding.
+static const char *default_script =
+    "voices 256\n"
+    "tempo 120\n"
+    "maqam hijaz\n"
+    "root D3\n"
+    "synth str pm_string\n"
+    "set str rel 1.5\n"
+    "synth bell pm_bell\n"
+    "set bell rel 2.0\n"
+    "synth cmb comb\n"
+    "set cmb rel 1.2\n"
+    "synth saw supersaw\n"
+    "set saw amp 0.3\n"
+    "set saw rel 1.0\n"
+    "pattern a (1 3 5 7 2 4 6 1' 3' 5 2 7 4 6 1 3)\n"
+    "pattern b (5 . 2 7 . 4 1' . 6 3 . 5 2 . 7 4)\n"
+    "play a str fast 4\n"
+    "play b bell fast 4\n"
+    "play a cmb fast 4 rev trans 3\n"
+    "play b saw fast 2\n";
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static char *read_text_file(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+    char *text = (char *)malloc((size_t)(size > 0 ? size : 0) + 1);
+    if (!text) {
+        fclose(file);
+        return NULL;
+    }
+    size_t len = fread(text, 1, (size_t)(size > 0 ? size : 0), file);
+    fclose(file);
+    text[len] = '\0';
+    return text;
+}
+
+typedef struct {
+    double elapsed;
+    double worst_block;
+    uint64_t hash;
+} RunResult;
+
+// Renders `seconds` of the program in `frames`-frame blocks on a fresh engine.
+static int run(const Program *program, int threads, int frames, double seconds, RunResult *result) {
+    char error[256] = {0};
+    EngineState *engine = (EngineState *)malloc(sizeof(EngineState));
+    float *out = (float *)malloc(sizeof(float) * 2 * (size_t)frames);
+    if (!engine || !out) {
+        fprintf(stderr, "Out of memory\n");
+        free(engine);
+        free(out);
+        return 0;
+    }
+    engine_init(engine);
+    if (!engine_set_voice_count(engine, program->voice_count, error, sizeof(error)) ||
+        !engine_set_render_threads(engine, threads, error, sizeof(error)) ||
+        !engine_load_program(engine, program, error, sizeof(error))) {
+        fprintf(stderr, "Engine setup failed: %s\n", error);
+        engine_free(engine);
+        free(engine);
+        free(out);
+        return 0;
+    }
+
+    long long total = (long long)(seconds * engine->sample_rate);
+    uint64_t hash = 0xcbf29ce484222325ull;
+    result->elapsed = 0.0;
+    result->worst_block = 0.0;
+    for (long long done = 0; done < total; done += frames) {
+        int n = (total - done < frames) ? (int)(total - done) : frames;
+        double start = now_seconds();
+        engine_render(engine, out, out + 1, 2, n);
+        double took = now_seconds() - start;
+        result->elapsed += took;
+        if (took > result->worst_block) {
+            result->worst_block = took;
+        }
+        const unsigned char *bytes = (const unsigned char *)out;
+        for (size_t i = 0; i < sizeof(float) * 2 * (size_t)n; i++) {
+            hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+        }
+    }
+    result->hash = hash;
+
+    engine_free(engine);
+    free(engine);
+    free(out);
+    return 1;
+}
+
+static int bench_mode(const char *name, const Program *program, int frames, double seconds, int max_threads) {
+    printf("%s mode, %d-frame blocks\n", name, frames);
+    printf("threads  x-realtime  speedup  worst block\n");
+    RunResult base;
+    int ok = 1;
+    for (int t = 1; t <= max_threads; t++) {
+        RunResult r;
+        if (!run(program, t, frames, seconds, &r)) {
+            return 0;
+        }
+        if (t == 1) {
+            base = r;
+        }
+        printf("%7d  %10.1f  %6.2fx  %8.3f ms%s\n", t, seconds / r.elapsed, base.elapsed / r.elapsed,
+               r.worst_block * 1e3, r.hash == base.hash ? "" : "  OUTPUT DIFFERS");
+        ok &= r.hash == base.hash;
+    }
+    return ok;
+}
+
+int main(int argc, const char *argv[]) {
+    const char *path = (argc > 1 && strcmp(argv[1], "-") != 0) ? argv[1] : NULL;
+    char *text = path ? read_text_file(path) : NULL;
+    if (path && !text) {
+        return 1;
+    }
+    double seconds = argc > 2 ? atof(argv[2]) : 20.0;
+    int max_threads = argc > 3 ? atoi(argv[3]) : ENGINE_MAX_RENDER_THREADS;
+    if (max_threads < 1) max_threads = 1;
+    if (max_threads > ENGINE_MAX_RENDER_THREADS) max_threads = ENGINE_MAX_RENDER_THREADS;
+
+    char error[256] = {0};
+    Program *program = (Program *)malloc(sizeof(Program));
+    if (!program) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    if (!dsl_parse_script(text ? text : default_script, program, error, sizeof(error))) {
+        fprintf(stderr, "%s\n", error);
+        return 1;
+    }
+    free(text);
+
+    printf("%s, %.1f s of audio\n", path ? path : "built-in script", seconds);
+    int ok = bench_mode("live", program, LIVE_FRAMES, seconds, max_threads);
+    printf("\n");
+    ok &= bench_mode("render", program, RENDER_FRAMES, seconds, max_threads);
+    free(program);
+    if (!ok) {
+        fprintf(stderr, "Output differs between thread counts\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,210 @@
+#include "engine_core.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Voice-loop microbenchmark. Keeps `voices` notes of one synth type sounding
+// (finished notes are restarted between blocks) and times engine_render, so
+// the figures cover the voice pass and little else.
+//
+//   jamal-bench [synth_type] [voices] [seconds]
+//
+// Defaults: sine, 256 voices, 10 seconds of audio at 48 kHz. On x86 the time
+// is also given in TSC cycles, and on Linux cache misses are counted when the
+// kernel exposes hardware counters. Afterwards the cost of single note-ons is
+// sampled and summarised as percentiles.
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static unsigned long long cycles_now(void) {
+#ifdef BENCH_HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Hardware counter around the timed renders; -1 when unavailable.
+static int counter_open(void) {
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+static void counter_enable(int fd, int on) {
+#ifdef __linux__
+    if (fd >= 0) {
+        ioctl(fd, on ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, 0);
+    }
+#else
+    (void)fd;
+    (void)on;
+#endif
+}
+
+static long long counter_read(int fd) {
+    long long value = -1;
+#ifdef __linux__
+    if (fd < 0 || read(fd, &value, sizeof(value)) != (ssize_t)sizeof(value)) {
+        value = -1;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+#else
+    (void)fd;
+#endif
+    return value;
+}
+
+static void fill_voices(EngineState *engine, const VoiceTemplate *tmpl, int voices, int *next_note) {
+    while (engine->alloc.held < voices) {
+        int v = voice_alloc_acquire(&engine->alloc, engine->voices, -1, STEAL_NONE, engine->sample_rate);
+        if (v < 0) {
+            break;
+        }
+        float freq = 110.0f * (1.0f + 0.01f * (float)(*next_note % 97));
+        voice_note_on(&engine->voices[v], tmpl, freq, (int)engine->sample_rate * 3600, 1.0f, 0, 0);
+        (*next_note)++;
+    }
+}
+
+#define NOTE_ON_SAMPLES 100000
+
+#ifdef BENCH_HAVE_TSC
+#define NOTE_ON_UNIT "cycles"
+#else
+#define NOTE_ON_UNIT "ns"
+#endif
+
+static unsigned long long note_on_ticks(void) {
+#ifdef BENCH_HAVE_TSC
+    return __rdtsc();
+#else
+    return (unsigned long long)(now_seconds() * 1e9);
+#endif
+}
+
+static int compare_ticks(const void *a, const void *b) {
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+    return (x > y) - (x < y);
+}
+
+// Starts notes back to back over the whole pitch range, stealing once the
+// pool is full, and times each voice_note_on call on its own.
+static void bench_note_on(EngineState *engine, const VoiceTemplate *tmpl) {
+    unsigned long long *cost = (unsigned long long *)malloc(sizeof(unsigned long long) * NOTE_ON_SAMPLES);
+    if (!cost) {
+        return;
+    }
+    for (int i = 0; i < NOTE_ON_SAMPLES; i++) {
+        int v = voice_alloc_acquire(&engine->alloc, engine->voices, -1, STEAL_OLDEST, engine->sample_rate);
+        float freq = 40.0f + 20.0f * (float)(i % 97);
+        unsigned long long start = note_on_ticks();
+        voice_note_on(&engine->voices[v], tmpl, freq, (int)engine->sample_rate, 1.0f, 0, i & 1);
+        cost[i] = note_on_ticks() - start;
+    }
+    qsort(cost, NOTE_ON_SAMPLES, sizeof(cost[0]), compare_ticks);
+    printf("note-on " NOTE_ON_UNIT ": p50 %llu, p90 %llu, p99 %llu, p99.9 %llu, max %llu\n",
+           cost[NOTE_ON_SAMPLES / 2], cost[NOTE_ON_SAMPLES * 9 / 10], cost[NOTE_ON_SAMPLES * 99 / 100],
+           cost[NOTE_ON_SAMPLES * 999 / 1000], cost[NOTE_ON_SAMPLES - 1]);
+    free(cost);
+}
+
+int main(int argc, const char *argv[]) {
+    const char *type = argc > 1 ? argv[1] : "sine";
+    int voices = argc > 2 ? atoi(argv[2]) : 256;
+    double seconds = argc > 3 ? atof(argv[3]) : 10.0;
+
+    // A silent pattern keeps the sequencer idle; notes come from fill_voices.
+    char script[160];
+    snprintf(script, sizeof(script), "voices %d\nsynth s %s\nset s sus 1\npattern rest (.)\nplay rest s\n", voices, type);
+    char error[256] = {0};
+    Program *program = (Program *)malloc(sizeof(Program));
+    EngineState *engine = (EngineState *)malloc(sizeof(EngineState));
+    if (!program || !engine) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    if (!dsl_parse_script(script, program, error, sizeof(error))) {
+        fprintf(stderr, "%s\n", error);
+        return 1;
+    }
+    engine_init(engine);
+    if (!engine_set_voice_count(engine, program->voice_count, error, sizeof(error)) ||
+        !engine_load_program(engine, program, error, sizeof(error))) {
+        fprintf(stderr, "Engine setup failed: %s\n", error);
+        return 1;
+    }
+    const VoiceTemplate *tmpl = &engine->prog->templates[0];
+
+    int frames = ENGINE_CHUNK_FRAMES;
+    float *out = (float *)calloc((size_t)frames * 2, sizeof(float));
+    long long blocks = (long long)(seconds * engine->sample_rate) / frames;
+    long long voice_samples = 0;
+    int next_note = 0;
+    double elapsed = 0.0;
+    unsigned long long cycles = 0;
+    int misses_fd = counter_open();
+    for (long long b = 0; b < blocks; b++) {
+        fill_voices(engine, tmpl, voices, &next_note);
+        voice_samples += (long long)engine->alloc.held * frames;
+        double start = now_seconds();
+        unsigned long long start_cycles = cycles_now();
+        counter_enable(misses_fd, 1);
+        engine_render(engine, out, out + 1, 2, frames);
+        counter_enable(misses_fd, 0);
+        cycles += cycles_now() - start_cycles;
+        elapsed += now_seconds() - start;
+    }
+    long long misses = counter_read(misses_fd);
+
+    printf("type %s, %d voices, %.1f s of audio\n", type, voices, seconds);
+    printf("voice %zu bytes hot + %zu cold, pool %zu bytes, delay lines %zu bytes\n",
+           sizeof(Voice), sizeof(VoiceCold),
+           (sizeof(Voice) + sizeof(VoiceCold)) * (size_t)engine->voice_slots,
+           engine->delays.top * sizeof(float));
+    printf("%.2f ns per voice-sample (%.1fx realtime)\n",
+           elapsed * 1e9 / (double)voice_samples, seconds / elapsed);
+#ifdef BENCH_HAVE_TSC
+    printf("%.1f cycles per voice-sample\n", (double)cycles / (double)voice_samples);
+#endif
+    if (misses >= 0) {
+        printf("%.4f cache misses per voice-sample\n", (double)misses / (double)voice_samples);
+    }
+    bench_note_on(engine, tmpl);
+
+    free(out);
+    engine_free(engine);
+    free(engine);
+    free(program);
+    return 0;
+}
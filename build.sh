@@ -3,7 +3,8 @@ set -euo pipefail
 
 mkdir -p build
 
-clang -std=c11 -fobjc-arc \
+# -ffp-contract=off keeps float results identical to the Linux render build.
+clang -std=c11 -O2 -fobjc-arc -ffp-contract=off \
   -framework Cocoa \
   -framework QuartzCore \
   -framework UniformTypeIdentifiers \
@@ -14,7 +15,19 @@ clang -std=c11 -fobjc-arc \
   src/main.m \
   src/meter_view.m \
   src/memory_map_view.m \
+  src/render_cli.c \
   src/audio_engine.c \
+  src/audio_backend_coreaudio.c \
+  src/engine_core.c \
+  src/voice.c \
+  src/voice_alloc.c \
+  src/delay_pool.c \
+  src/control_ring.c \
+  src/meter_ring.c \
+  src/render_pool.c \
+  src/render_cache.c \
+  src/dsp_math.c \
+  src/wav_writer.c \
   src/dsl.c
 
 echo "Built build/livecode"
@@ -0,0 +1,33 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Headless render binary for Linux (and any other POSIX host). Produces the
+# same samples as build/livecode --render on macOS.
+
+mkdir -p build
+
+CC="${CC:-cc}"
+# Extra flags, e.g. CFLAGS=-mavx2 for wider SIMD voice banks. Output is the
+# same either way.
+CFLAGS="${CFLAGS:-}"
+
+"$CC" -std=c11 -O2 -ffp-contract=off -D_DEFAULT_SOURCE $CFLAGS \
+  -o build/jamal-render \
+  src/render_main.c \
+  src/render_cli.c \
+  src/audio_engine.c \
+  src/audio_backend_null.c \
+  src/engine_core.c \
+  src/voice.c \
+  src/voice_alloc.c \
+  src/delay_pool.c \
+  src/control_ring.c \
+  src/meter_ring.c \
+  src/render_pool.c \
+  src/render_cache.c \
+  src/dsp_math.c \
+  src/wav_writer.c \
+  src/dsl.c \
+  -lm -pthread
+
+echo "Built build/jamal-render"
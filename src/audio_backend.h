@@ -0,0 +1,28 @@
+#ifndef AUDIO_BACKEND_H
+#define AUDIO_BACKEND_H
+
+#include <stddef.h>
+
+// Live audio output. Exactly one implementation is linked per platform:
+// audio_backend_coreaudio.c on macOS, audio_backend_null.c elsewhere.
+
+typedef void (*AudioBackendRenderFn)(void *user, float *out_l, float *out_r, int stride, int frames);
+
+typedef struct {
+    double sample_rate;
+    int buffer_frames;
+    unsigned int device_id; // 0 selects the system default output
+    AudioBackendRenderFn render;
+    void *user;
+} AudioBackendConfig;
+
+typedef struct AudioBackend AudioBackend;
+
+// Opens the output device and starts pulling frames through config->render
+// on the device's real-time thread. Returns NULL and fills `error` on failure.
+AudioBackend *audio_backend_open(const AudioBackendConfig *config, char *error, size_t error_len);
+
+// Stops the device; no render calls are in flight once this returns.
+void audio_backend_close(AudioBackend *backend);
+
+#endif
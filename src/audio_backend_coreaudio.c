@@ -0,0 +1,161 @@
+#include "audio_backend.h"
+
+#include <AudioToolbox/AudioToolbox.h>
+#include <CoreAudio/CoreAudioTypes.h>
+#include <CoreAudio/AudioHardware.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct AudioBackend {
+    AudioUnit audio_unit;
+    AudioBackendRenderFn render;
+    void *user;
+};
+
+static OSStatus render_callback(void *in_ref_con,
+                                AudioUnitRenderActionFlags *io_action_flags,
+                                const AudioTimeStamp *in_time_stamp,
+                                UInt32 in_bus_number,
+                                UInt32 in_number_frames,
+                                AudioBufferList *io_data) {
+    (void)io_action_flags;
+    (void)in_time_stamp;
+    (void)in_bus_number;
+
+    AudioBackend *backend = (AudioBackend *)in_ref_con;
+    bool interleaved = (io_data->mNumberBuffers == 1);
+    float *out_l = (float *)io_data->mBuffers[0].mData;
+    if (interleaved) {
+        backend->render(backend->user, out_l, out_l + 1, 2, (int)in_number_frames);
+    } else {
+        float *out_r = (float *)io_data->mBuffers[1].mData;
+        backend->render(backend->user, out_l, out_r, 1, (int)in_number_frames);
+    }
+    return noErr;
+}
+
+static void dispose_audio_unit(AudioBackend *backend) {
+    AudioOutputUnitStop(backend->audio_unit);
+    AudioUnitUninitialize(backend->audio_unit);
+    AudioComponentInstanceDispose(backend->audio_unit);
+    backend->audio_unit = NULL;
+}
+
+AudioBackend *audio_backend_open(const AudioBackendConfig *config, char *error, size_t error_len) {
+    AudioComponentDescription desc = {0};
+    desc.componentType = kAudioUnitType_Output;
+    desc.componentSubType = kAudioUnitSubType_DefaultOutput;
+    desc.componentManufacturer = kAudioUnitManufacturer_Apple;
+
+    AudioComponent comp = AudioComponentFindNext(NULL, &desc);
+    if (!comp) {
+        snprintf(error, error_len, "Failed to start CoreAudio output");
+        return NULL;
+    }
+
+    AudioBackend *backend = (AudioBackend *)calloc(1, sizeof(AudioBackend));
+    if (!backend) {
+        snprintf(error, error_len, "Out of memory");
+        return NULL;
+    }
+    backend->render = config->render;
+    backend->user = config->user;
+
+    OSStatus status = AudioComponentInstanceNew(comp, &backend->audio_unit);
+    if (status != noErr) {
+        free(backend);
+        snprintf(error, error_len, "Failed to start CoreAudio output");
+        return NULL;
+    }
+
+    AudioDeviceID dev = (AudioDeviceID)config->device_id;
+    if (dev != 0) {
+        status = AudioUnitSetProperty(backend->audio_unit,
+                                      kAudioOutputUnitProperty_CurrentDevice,
+                                      kAudioUnitScope_Global,
+                                      0,
+                                      &dev,
+                                      sizeof(dev));
+        if (status != noErr) {
+            // Fallback to default device.
+            dev = 0;
+        }
+    }
+
+    if (dev != 0) {
+        UInt32 frames = (UInt32)config->buffer_frames;
+        AudioObjectPropertyAddress addr = {
+            kAudioDevicePropertyBufferFrameSize,
+            kAudioObjectPropertyScopeOutput,
+            kAudioObjectPropertyElementMain
+        };
+        AudioObjectSetPropertyData(dev, &addr, 0, NULL, sizeof(frames), &frames);
+
+        Float64 rate = config->sample_rate;
+        AudioObjectPropertyAddress rateAddr = {
+            kAudioDevicePropertyNominalSampleRate,
+            kAudioObjectPropertyScopeOutput,
+            kAudioObjectPropertyElementMain
+        };
+        AudioObjectSetPropertyData(dev, &rateAddr, 0, NULL, sizeof(rate), &rate);
+    }
+
+    UInt32 maxFrames = (UInt32)config->buffer_frames;
+    AudioUnitSetProperty(backend->audio_unit,
+                         kAudioUnitProperty_MaximumFramesPerSlice,
+                         kAudioUnitScope_Global,
+                         0,
+                         &maxFrames,
+                         sizeof(maxFrames));
+
+    AURenderCallbackStruct callback = {0};
+    callback.inputProc = render_callback;
+    callback.inputProcRefCon = backend;
+    status = AudioUnitSetProperty(backend->audio_unit,
+                                  kAudioUnitProperty_SetRenderCallback,
+                                  kAudioUnitScope_Input,
+                                  0,
+                                  &callback,
+                                  sizeof(callback));
+    if (status == noErr) {
+        AudioStreamBasicDescription format = {0};
+        format.mSampleRate = config->sample_rate;
+        format.mFormatID = kAudioFormatLinearPCM;
+        format.mFormatFlags = kAudioFormatFlagIsFloat | kAudioFormatFlagIsPacked;
+        format.mBytesPerPacket = sizeof(float) * 2;
+        format.mFramesPerPacket = 1;
+        format.mBytesPerFrame = sizeof(float) * 2;
+        format.mChannelsPerFrame = 2;
+        format.mBitsPerChannel = 32;
+
+        status = AudioUnitSetProperty(backend->audio_unit,
+                                      kAudioUnitProperty_StreamFormat,
+                                      kAudioUnitScope_Input,
+                                      0,
+                                      &format,
+                                      sizeof(format));
+    }
+    if (status == noErr) {
+        status = AudioUnitInitialize(backend->audio_unit);
+    }
+    if (status == noErr) {
+        status = AudioOutputUnitStart(backend->audio_unit);
+    }
+    if (status != noErr) {
+        dispose_audio_unit(backend);
+        free(backend);
+        snprintf(error, error_len, "Failed to start CoreAudio output");
+        return NULL;
+    }
+
+    return backend;
+}
+
+void audio_backend_close(AudioBackend *backend) {
+    if (!backend) {
+        return;
+    }
+    dispose_audio_unit(backend);
+    free(backend);
+}
@@ -0,0 +1,15 @@
+#include "audio_backend.h"
+
+#include <stdio.h>
+
+// Headless builds have no output device; only offline rendering is available.
+
+AudioBackend *audio_backend_open(const AudioBackendConfig *config, char *error, size_t error_len) {
+    (void)config;
+    snprintf(error, error_len, "No audio output available in this build (use --render)");
+    return NULL;
+}
+
+void audio_backend_close(AudioBackend *backend) {
+    (void)backend;
+}
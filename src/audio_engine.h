@@ -15,17 +15,111 @@ int audio_engine_play_script(const char *script, char *error, size_t error_len);
 
 void audio_engine_stop(void);
 
+// Output meters of one audio block.
+typedef struct {
+    unsigned long long frame; // first frame of the block since the engine started
+    int frames;
+    float rms_l;
+    float rms_r;
+    float peak_l;
+    float peak_r;
+    int clip;
+} AudioMeterBlock;
+
+// Meters come from a queue holding a record for every block the live output
+// renders. Use these from one thread only: the getters below and
+// audio_engine_read_meter_blocks take records from the same queue.
+//
+// audio_engine_read_meter_blocks copies up to `max` unread blocks, oldest
+// first, and returns how many. Blocks the reader was too slow for are counted
+// by audio_engine_get_meter_drops.
+int audio_engine_read_meter_blocks(AudioMeterBlock *out, int max);
+unsigned long long audio_engine_get_meter_drops(void);
+
+// RMS of the latest block. get_meter_ex also reports the highest peak and
+// whether anything clipped since its previous call.
 void audio_engine_get_meter(float *out_left, float *out_right);
 void audio_engine_get_meter_ex(float *out_rms_l, float *out_rms_r, float *out_peak_l, float *out_peak_r, int *out_clip);
+// Notes started, stolen and dropped since the live script was loaded, or
+// during the last offline render.
+void audio_engine_get_voice_stats(unsigned long long *out_allocs, unsigned long long *out_steals, unsigned long long *out_drops);
+void audio_engine_get_render_voice_stats(unsigned long long *out_allocs, unsigned long long *out_steals, unsigned long long *out_drops);
 int audio_engine_is_running(void);
 float audio_engine_get_tempo(void);
 unsigned long long audio_engine_get_pattern_epoch(void);
+// Real-time controls for the live script. They are queued to the audio thread
+// without locks and take effect at the start of its next block, so they can
+// be sent at controller rate. Call them all from one thread. amp, cutoff,
+// res, drive, excite and the master gain glide to the new value over about
+// 10 ms; other params apply from the next note. Tracks count play lines from
+// 0, and mute and solo stay set across re-evaluation. Params and tempo last
+// until the next script takes over. The int functions return 0 if the
+// param is unknown or the queue is full.
 void audio_engine_set_master(float amp);
+int audio_engine_set_param(const char *synth, const char *param, float value);
+int audio_engine_set_tempo(float bpm);
+int audio_engine_set_track_mute(int track, int muted);
+int audio_engine_set_track_solo(int track, int soloed);
 void audio_engine_set_output_device(unsigned int device_id);
 void audio_engine_set_sample_rate(double sample_rate);
 void audio_engine_set_buffer_frames(int frames);
 void audio_engine_set_bit_depth(int bits);
+// Sample format of rendered files and streams: 32-bit float (the default,
+// and whenever is_float is set) or 16, 24 or 32-bit integer PCM. Unlike the
+// bit depth it only changes how the audio is stored; a file format matching
+// the bit depth stores the engine's quantized samples exactly.
+void audio_engine_set_file_format(int bits, int is_float);
+// Threads that render voices, 1 to 16, counting the audio thread. Like the
+// sample rate, it applies to offline renders and from the next time the live
+// output starts. Any count gives the same output.
+void audio_engine_set_render_threads(int threads);
 int audio_engine_render_to_wav(const char *script, const char *path, double seconds, int sample_rate, int buffer_frames, char *error, size_t error_len);
+// audio_engine_render_to_wav, extended for pipelines. A `path` of "-" streams
+// to stdout, as a WAV header of unknown length or, with raw set, as bare
+// little-endian stereo samples in the file format. `seconds` may be INFINITY
+// to render until stopped. With until_silence the render also stops once the output has
+// been silent (below -100 dBFS) for 2 seconds after its first sound.
+int audio_engine_render_stream(const char *script, const char *path, double seconds, int until_silence, int raw, int sample_rate, int buffer_frames, char *error, size_t error_len);
+// Renders one stereo stem per play/playseq line plus one for drones (if the
+// script has any) in a single pass. With multichannel 0, `path` is a
+// directory, created if missing, that receives mix.wav and
+// NN_<pattern>_<synth>.wav / drones.wav; otherwise `path` is one WAV file
+// with a channel pair per stem. Stems sum to the mix as engine_stem_count
+// describes.
+int audio_engine_render_stems(const char *script, const char *path, double seconds, int sample_rate, int buffer_frames, int multichannel, char *error, size_t error_len);
+
+// One render of a batch. The caller fills in the first five fields; the
+// batch fills in the rest.
+typedef struct {
+    const char *script; // script text
+    const char *output_path;
+    double seconds;
+    int sample_rate;
+    int buffer_frames;
+    int ok;
+    int cached; // reused from the render cache
+    double elapsed; // wall-clock seconds the job took
+    char error[256];
+} AudioRenderJob;
+
+// Renders the jobs as audio_engine_render_to_wav would, up to `threads` (1 to
+// 64) at a time on their own engines with one render thread each, so a
+// batch's output matches rendering its jobs one by one. A failed job doesn't
+// stop the others. Call audio_engine_init first. Returns the number of
+// failed jobs.
+int audio_engine_render_batch(AudioRenderJob *jobs, int count, int threads);
+
+// Keeps finished renders in `dir` (created if missing), keyed on the parsed
+// program, length, sample rate, buffer size, bit depth, file format and
+// ENGINE_RENDER_VERSION. Rendering the same thing again to a file, through
+// render_to_wav, render_stream or a batch, then reuses the earlier file, even
+// if the script's comments or whitespace changed. The output is hard-linked
+// to the cache entry where possible, else copied; don't edit it in place.
+// Entries used least recently are removed once they pass max_bytes. A NULL
+// dir turns the cache off. Returns 0 if the directory can't be created.
+int audio_engine_set_render_cache(const char *dir, unsigned long long max_bytes, char *error, size_t error_len);
+// Whether the last render_to_wav or render_stream came from the cache.
+int audio_engine_render_was_cached(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,30 @@
+#include "control_ring.h"
+
+_Static_assert((CONTROL_RING_SIZE & (CONTROL_RING_SIZE - 1)) == 0, "ring size must be a power of two");
+
+void control_ring_init(ControlRing *ring) {
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+}
+
+bool control_ring_push(ControlRing *ring, const ControlCommand *cmd) {
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail == CONTROL_RING_SIZE) {
+        return false;
+    }
+    ring->slots[head & (CONTROL_RING_SIZE - 1)] = *cmd;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+bool control_ring_pop(ControlRing *ring, ControlCommand *out) {
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (head == tail) {
+        return false;
+    }
+    *out = ring->slots[tail & (CONTROL_RING_SIZE - 1)];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return true;
+}
@@ -0,0 +1,47 @@
+#ifndef CONTROL_RING_H
+#define CONTROL_RING_H
+
+#include "dsl.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Real-time control commands from one control thread to the audio thread. A
+// fixed single-producer, single-consumer ring: pushing and popping are a few
+// loads and stores, never lock and never allocate. A full ring refuses the
+// command rather than wait.
+
+#define CONTROL_RING_SIZE 1024 // commands, a power of two
+
+typedef enum {
+    CONTROL_PARAM,  // synth `synth`, parameter `param` to `value`
+    CONTROL_TEMPO,  // tempo to `value` BPM
+    CONTROL_MASTER, // master gain to `value`
+    CONTROL_MUTE,   // track `track` muted if `value` is nonzero
+    CONTROL_SOLO    // track `track` soloed if `value` is nonzero
+} ControlType;
+
+typedef struct {
+    ControlType type;
+    SynthParam param;
+    int track; // index of the play line, from 0
+    float value;
+    char synth[DSL_MAX_NAME];
+} ControlCommand;
+
+typedef struct {
+    ControlCommand slots[CONTROL_RING_SIZE];
+    // Free-running counters; the slot is the counter modulo the size.
+    _Alignas(64) atomic_uint head; // written by the producer
+    _Alignas(64) atomic_uint tail; // written by the consumer
+} ControlRing;
+
+void control_ring_init(ControlRing *ring);
+
+// Producer side. Returns false if the ring is full.
+bool control_ring_push(ControlRing *ring, const ControlCommand *cmd);
+
+// Consumer side. Returns false if the ring is empty.
+bool control_ring_pop(ControlRing *ring, ControlCommand *out);
+
+#endif
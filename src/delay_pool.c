@@ -0,0 +1,64 @@
+#include "delay_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static int size_class(int len) {
+    int bits = DELAY_POOL_MIN_BITS;
+    while ((1 << bits) < len) {
+        bits++;
+    }
+    return bits - DELAY_POOL_MIN_BITS;
+}
+
+int delay_pool_init(DelayPool *pool, int lines) {
+    memset(pool, 0, sizeof(*pool));
+    // Lines freed into one class can't serve another, so in the worst case
+    // every line has been carved once per class: just under two maximum-size
+    // lines each. Arena pages no line has reached are never written.
+    size_t capacity = (size_t)lines * 2 * DELAY_POOL_MAX_LEN;
+    pool->arena = (float *)aligned_alloc(64, capacity * sizeof(float));
+    if (!pool->arena) {
+        return 0;
+    }
+    pool->capacity = capacity;
+    return 1;
+}
+
+void delay_pool_free(DelayPool *pool) {
+    free(pool->arena);
+    memset(pool, 0, sizeof(*pool));
+}
+
+void delay_pool_reset(DelayPool *pool) {
+    pool->top = 0;
+    for (int c = 0; c < DELAY_POOL_CLASSES; c++) {
+        pool->free_lines[c] = NULL;
+    }
+}
+
+// Free lines are chained through their first bytes.
+float *delay_pool_acquire(DelayPool *pool, int len) {
+    if (len < 1 || len > DELAY_POOL_MAX_LEN) {
+        return NULL;
+    }
+    int c = size_class(len);
+    float *line = pool->free_lines[c];
+    if (line) {
+        memcpy(&pool->free_lines[c], line, sizeof(float *));
+        return line;
+    }
+    size_t size = (size_t)1 << (c + DELAY_POOL_MIN_BITS);
+    if (pool->top + size > pool->capacity) {
+        return NULL;
+    }
+    line = pool->arena + pool->top;
+    pool->top += size;
+    return line;
+}
+
+void delay_pool_release(DelayPool *pool, float *line, int len) {
+    int c = size_class(len);
+    memcpy(line, &pool->free_lines[c], sizeof(float *));
+    pool->free_lines[c] = line;
+}
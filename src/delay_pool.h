@@ -0,0 +1,38 @@
+#ifndef DELAY_POOL_H
+#define DELAY_POOL_H
+
+#include <stddef.h>
+
+// Delay-line memory for comb and physical-model voices. Lines are carved from
+// one preallocated arena in power-of-two size classes and recycled through
+// per-class free lists, so checking a line out or back in is O(1) and never
+// allocates. Voices that don't need a delay line never touch the arena.
+
+#define DELAY_POOL_MIN_BITS 6  // 64 samples
+#define DELAY_POOL_MAX_BITS 12 // 4096 samples
+#define DELAY_POOL_MAX_LEN (1 << DELAY_POOL_MAX_BITS)
+#define DELAY_POOL_CLASSES (DELAY_POOL_MAX_BITS - DELAY_POOL_MIN_BITS + 1)
+
+typedef struct {
+    float *arena;
+    size_t capacity; // samples
+    size_t top;      // samples handed out from the arena so far
+    float *free_lines[DELAY_POOL_CLASSES];
+} DelayPool;
+
+// Sizes the arena so `lines` delay lines of any mix of lengths can be checked
+// out at once. Returns 0 when out of memory.
+int delay_pool_init(DelayPool *pool, int lines);
+void delay_pool_free(DelayPool *pool);
+
+// Returns every line to the arena.
+void delay_pool_reset(DelayPool *pool);
+
+// Checks out a line of at least `len` samples (at most DELAY_POOL_MAX_LEN).
+// The contents are undefined. Returns NULL if the pool is exhausted.
+float *delay_pool_acquire(DelayPool *pool, int len);
+
+// Checks a line back in; `len` must match the acquire call.
+void delay_pool_release(DelayPool *pool, float *line, int len);
+
+#endif
@@ -2,6 +2,7 @@
 
 #include <ctype.h>
 #include <math.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -21,6 +22,8 @@ static void set_default_program(Program *program) {
     }
     program->time_sig_enforce = 0;
     program->time_sig_seq_len = 0;
+    program->steal_policy = STEAL_RELEASE;
+    program->commit_mode = COMMIT_NOW;
     float neutral[7] = {0, 200, 400, 500, 700, 900, 1100};
     memcpy(program->maqam_offsets, neutral, sizeof(neutral));
 }
@@ -736,6 +739,38 @@ int dsl_find_sequence(const Program *program, const char *name) {
     return -1;
 }
 
+static const struct {
+    const char *name;
+    size_t offset;
+} synth_params[] = {
+    [SYNTH_PARAM_AMP] = {"amp", offsetof(SynthDef, amp)},
+    [SYNTH_PARAM_CUTOFF] = {"cutoff", offsetof(SynthDef, cutoff)},
+    [SYNTH_PARAM_RES] = {"res", offsetof(SynthDef, res)},
+    [SYNTH_PARAM_ATK] = {"atk", offsetof(SynthDef, atk)},
+    [SYNTH_PARAM_DEC] = {"dec", offsetof(SynthDef, dec)},
+    [SYNTH_PARAM_SUS] = {"sus", offsetof(SynthDef, sus)},
+    [SYNTH_PARAM_REL] = {"rel", offsetof(SynthDef, rel)},
+    [SYNTH_PARAM_FEEDBACK] = {"feedback", offsetof(SynthDef, comb_feedback)},
+    [SYNTH_PARAM_DAMP] = {"damp", offsetof(SynthDef, comb_damp)},
+    [SYNTH_PARAM_EXCITE] = {"excite", offsetof(SynthDef, comb_excite)},
+    [SYNTH_PARAM_DETUNE_RATE] = {"detune_rate", offsetof(SynthDef, detune_rate)},
+    [SYNTH_PARAM_DETUNE_DEPTH] = {"detune_depth", offsetof(SynthDef, detune_depth)},
+    [SYNTH_PARAM_DRIVE] = {"drive", offsetof(SynthDef, drive)},
+};
+
+int dsl_synth_param(const char *name) {
+    for (int i = 0; i < (int)(sizeof(synth_params) / sizeof(synth_params[0])); i++) {
+        if (strcmp(synth_params[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+float *dsl_synth_param_field(SynthDef *synth, SynthParam param) {
+    return (float *)((char *)synth + synth_params[param].offset);
+}
+
 static void set_default_synth(SynthDef *synth) {
     synth->amp = 0.5f;
     synth->cutoff = 18000.0f;
@@ -861,6 +896,78 @@ int dsl_parse_script(const char *script, Program *out_program, char *error, size
             continue;
         }
 
+        if (strcmp(cmd, "control_block") == 0) {
+            char frames_token[32] = {0};
+            if (!next_token(&cursor, frames_token, sizeof(frames_token), 0)) {
+                snprintf(error, error_len, "Line %d: control_block requires a frame count", line_num);
+                free(script_copy);
+                return 0;
+            }
+            int frames = atoi(frames_token);
+            if (frames < 1 || frames > 256) {
+                snprintf(error, error_len, "Line %d: control_block out of range (1-256)", line_num);
+                free(script_copy);
+                return 0;
+            }
+            out_program->control_frames = frames;
+            continue;
+        }
+
+        if (strcmp(cmd, "voices") == 0) {
+            char count_token[32] = {0};
+            if (!next_token(&cursor, count_token, sizeof(count_token), 0)) {
+                snprintf(error, error_len, "Line %d: voices requires a count", line_num);
+                free(script_copy);
+                return 0;
+            }
+            int count = atoi(count_token);
+            if (count < 1 || count > DSL_MAX_VOICES) {
+                snprintf(error, error_len, "Line %d: voices out of range (1-%d)", line_num, DSL_MAX_VOICES);
+                free(script_copy);
+                return 0;
+            }
+            out_program->voice_count = count;
+            continue;
+        }
+
+        if (strcmp(cmd, "steal") == 0) {
+            char policy_token[32] = {0};
+            if (!next_token(&cursor, policy_token, sizeof(policy_token), 0)) {
+                snprintf(error, error_len, "Line %d: steal requires a policy", line_num);
+                free(script_copy);
+                return 0;
+            }
+            if (strcmp(policy_token, "none") == 0) out_program->steal_policy = STEAL_NONE;
+            else if (strcmp(policy_token, "oldest") == 0) out_program->steal_policy = STEAL_OLDEST;
+            else if (strcmp(policy_token, "quietest") == 0) out_program->steal_policy = STEAL_QUIETEST;
+            else if (strcmp(policy_token, "track") == 0) out_program->steal_policy = STEAL_SAME_TRACK;
+            else if (strcmp(policy_token, "release") == 0) out_program->steal_policy = STEAL_RELEASE;
+            else {
+                snprintf(error, error_len, "Line %d: unknown steal policy '%s'", line_num, policy_token);
+                free(script_copy);
+                return 0;
+            }
+            continue;
+        }
+
+        if (strcmp(cmd, "commit") == 0) {
+            char mode_token[32] = {0};
+            if (!next_token(&cursor, mode_token, sizeof(mode_token), 0)) {
+                snprintf(error, error_len, "Line %d: commit requires now, bar or section", line_num);
+                free(script_copy);
+                return 0;
+            }
+            if (strcmp(mode_token, "now") == 0) out_program->commit_mode = COMMIT_NOW;
+            else if (strcmp(mode_token, "bar") == 0) out_program->commit_mode = COMMIT_BAR;
+            else if (strcmp(mode_token, "section") == 0) out_program->commit_mode = COMMIT_SECTION;
+            else {
+                snprintf(error, error_len, "Line %d: unknown commit mode '%s'", line_num, mode_token);
+                free(script_copy);
+                return 0;
+            }
+            continue;
+        }
+
         if (strcmp(cmd, "tempo_map") == 0) {
             char map[256] = {0};
             if (!next_token(&cursor, map, sizeof(map), 1)) {
@@ -1213,26 +1320,13 @@ int dsl_parse_script(const char *script, Program *out_program, char *error, size
                 free(script_copy);
                 return 0;
             }
-            SynthDef *synth = &out_program->synths[idx];
-            float v = (float)atof(value);
-            if (strcmp(param, "amp") == 0) synth->amp = v;
-            else if (strcmp(param, "cutoff") == 0) synth->cutoff = v;
-            else if (strcmp(param, "res") == 0) synth->res = v;
-            else if (strcmp(param, "atk") == 0) synth->atk = v;
-            else if (strcmp(param, "dec") == 0) synth->dec = v;
-            else if (strcmp(param, "sus") == 0) synth->sus = v;
-            else if (strcmp(param, "rel") == 0) synth->rel = v;
-            else if (strcmp(param, "feedback") == 0) synth->comb_feedback = v;
-            else if (strcmp(param, "damp") == 0) synth->comb_damp = v;
-            else if (strcmp(param, "excite") == 0) synth->comb_excite = v;
-            else if (strcmp(param, "detune_rate") == 0) synth->detune_rate = v;
-            else if (strcmp(param, "detune_depth") == 0) synth->detune_depth = v;
-            else if (strcmp(param, "drive") == 0) synth->drive = v;
-            else {
+            int p = dsl_synth_param(param);
+            if (p < 0) {
                 snprintf(error, error_len, "Line %d: unknown param '%s'", line_num, param);
                 free(script_copy);
                 return 0;
             }
+            *dsl_synth_param_field(&out_program->synths[idx], (SynthParam)p) = (float)atof(value);
             continue;
         }
 
@@ -1242,15 +1336,13 @@ int dsl_parse_script(const char *script, Program *out_program, char *error, size
             char src_token[32] = {0};
             char rate_token[32] = {0};
             char depth_token[32] = {0};
-            char offset_token[32] = {0};
-            char lag_token[32] = {0};
-            char slew_token[32] = {0};
+            char extra_token[32] = {0};
             if (!next_token(&cursor, synth_name, sizeof(synth_name), 0) ||
                 !next_token(&cursor, dest_token, sizeof(dest_token), 0) ||
                 !next_token(&cursor, src_token, sizeof(src_token), 0) ||
                 !next_token(&cursor, rate_token, sizeof(rate_token), 0) ||
                 !next_token(&cursor, depth_token, sizeof(depth_token), 0)) {
-                snprintf(error, error_len, "Line %d: mod requires synth dest source rate depth [offset] [lag] [slew]", line_num);
+                snprintf(error, error_len, "Line %d: mod requires synth dest source rate depth [offset] [lag] [slew] [audio]", line_num);
                 free(script_copy);
                 return 0;
             }
@@ -1298,15 +1390,20 @@ int dsl_parse_script(const char *script, Program *out_program, char *error, size
             float offset = 0.0f;
             float lag_ms = 0.0f;
             float slew_ms = 0.0f;
+            int audio_rate = 0;
+            int extra_count = 0;
 
-            if (next_token(&cursor, offset_token, sizeof(offset_token), 0)) {
-                offset = (float)atof(offset_token);
-                if (next_token(&cursor, lag_token, sizeof(lag_token), 0)) {
-                    lag_ms = (float)atof(lag_token);
-                    if (next_token(&cursor, slew_token, sizeof(slew_token), 0)) {
-                        slew_ms = (float)atof(slew_token);
-                    }
+            // Optional offset, lag and slew in that order; `audio` may follow.
+            while (next_token(&cursor, extra_token, sizeof(extra_token), 0)) {
+                if (strcmp(extra_token, "audio") == 0) {
+                    audio_rate = 1;
+                    continue;
                 }
+                float v = (float)atof(extra_token);
+                if (extra_count == 0) offset = v;
+                else if (extra_count == 1) lag_ms = v;
+                else if (extra_count == 2) slew_ms = v;
+                extra_count++;
             }
 
             ModDef *mod = &synth->mods[synth->mod_count++];
@@ -1317,6 +1414,7 @@ int dsl_parse_script(const char *script, Program *out_program, char *error, size
             mod->offset = offset;
             mod->lag_ms = lag_ms;
             mod->slew_ms = slew_ms;
+            mod->audio_rate = audio_rate;
             continue;
         }
 
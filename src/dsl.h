@@ -11,6 +11,7 @@
 #define DSL_MAX_SEQUENCES 8
 #define DSL_MAX_SEQUENCE_STEPS 32
 #define DSL_MAX_DRONES 4
+#define DSL_MAX_VOICES 1024
 
 typedef enum {
     SYNTH_SINE,
@@ -69,6 +70,39 @@ typedef enum {
     MOD_DEST_PITCH
 } ModDest;
 
+// Which sounding voice gives way when a note starts with every voice busy.
+typedef enum {
+    STEAL_NONE,       // drop the new note
+    STEAL_OLDEST,
+    STEAL_QUIETEST,
+    STEAL_SAME_TRACK, // oldest voice of the same track, else oldest
+    STEAL_RELEASE     // oldest voice already releasing, else oldest
+} StealPolicy;
+
+// The parameters `set` can change on a synth.
+typedef enum {
+    SYNTH_PARAM_AMP,
+    SYNTH_PARAM_CUTOFF,
+    SYNTH_PARAM_RES,
+    SYNTH_PARAM_ATK,
+    SYNTH_PARAM_DEC,
+    SYNTH_PARAM_SUS,
+    SYNTH_PARAM_REL,
+    SYNTH_PARAM_FEEDBACK,
+    SYNTH_PARAM_DAMP,
+    SYNTH_PARAM_EXCITE,
+    SYNTH_PARAM_DETUNE_RATE,
+    SYNTH_PARAM_DETUNE_DEPTH,
+    SYNTH_PARAM_DRIVE
+} SynthParam;
+
+// When a re-evaluated program takes over from the one playing.
+typedef enum {
+    COMMIT_NOW,     // at the start of the next audio block
+    COMMIT_BAR,     // at the next bar line
+    COMMIT_SECTION  // at the next step of the leading sequence, else the next bar
+} CommitMode;
+
 typedef struct ModDef {
     ModSource source;
     ModDest dest;
@@ -77,6 +111,7 @@ typedef struct ModDef {
     float offset;
     float lag_ms;
     float slew_ms;
+    int audio_rate; // evaluate every sample instead of once per control block
 } ModDef;
 
 typedef struct {
@@ -168,6 +203,10 @@ typedef struct {
     int time_sig_seq_len;
     int time_sig_seq_num[1024];
     int time_sig_seq_den[1024];
+    int control_frames; // modulation control block, 0 = engine default
+    StealPolicy steal_policy;
+    CommitMode commit_mode;
+    int voice_count; // polyphony, 0 = engine default
 
     int synth_count;
     SynthDef synths[DSL_MAX_SYNTHS];
@@ -191,4 +230,9 @@ int dsl_find_synth(const Program *program, const char *name);
 int dsl_find_pattern(const Program *program, const char *name);
 int dsl_find_sequence(const Program *program, const char *name);
 
+// Looks up a `set` parameter by name; -1 if there is none.
+int dsl_synth_param(const char *name);
+// The field of `synth` that holds `param`.
+float *dsl_synth_param_field(SynthDef *synth, SynthParam param);
+
 #endif
@@ -0,0 +1,17 @@
+#include "dsp_math.h"
+
+#include <stdbool.h>
+
+// Sine table for dsp_sin_phase: DSP_SINE_TABLE_SIZE segments plus a guard point.
+float dsp_sine_table[DSP_SINE_TABLE_SIZE + 1];
+
+void dsp_init_tables(void) {
+    static bool initialized = false;
+    if (initialized) {
+        return;
+    }
+    for (int i = 0; i <= DSP_SINE_TABLE_SIZE; i++) {
+        dsp_sine_table[i] = (float)dsp_sin_d(2.0 * DSP_PI_D * (double)i / (double)DSP_SINE_TABLE_SIZE);
+    }
+    initialized = true;
+}
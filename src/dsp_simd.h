@@ -0,0 +1,261 @@
+#ifndef DSP_SIMD_H
+#define DSP_SIMD_H
+
+#include "dsp_math.h"
+
+#include <stdint.h>
+
+// Four-lane float vectors for rendering voices in lockstep.
+//
+// Every operation here produces exactly the bits of the scalar code it
+// replaces: lanes only use IEEE add/sub/mul/div/compare and integer phase
+// arithmetic, sine comes from the shared table, and dsp_f4_tanh evaluates
+// the same double-precision reduction and polynomial as dsp_tanhf, with
+// nearbyint() replaced by the 1.5 * 2^52 round-to-nearest trick. So SSE2,
+// AVX2 and the scalar fallback all render the same audio, and a banked
+// voice sounds bit-for-bit like a voice rendered alone.
+//
+// SSE2 is the x86-64 baseline. Building with -mavx2 gathers table entries
+// and evaluates tanh four lanes at a time; -DDSP_NO_SIMD forces the scalar
+// fallback.
+
+#if (defined(__SSE2__) || defined(_M_X64)) && !defined(DSP_NO_SIMD)
+#define DSP_SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(DSP_SIMD_SSE2) && defined(__AVX2__)
+#define DSP_SIMD_AVX2 1
+#include <immintrin.h>
+#endif
+
+#define DSP_F4_LANES 4
+
+#if defined(DSP_SIMD_SSE2)
+
+typedef __m128 dsp_f4;
+
+static inline dsp_f4 dsp_f4_load(const float *p) { return _mm_load_ps(p); }
+static inline void dsp_f4_store(float *p, dsp_f4 a) { _mm_store_ps(p, a); }
+static inline dsp_f4 dsp_f4_set1(float x) { return _mm_set1_ps(x); }
+static inline dsp_f4 dsp_f4_add(dsp_f4 a, dsp_f4 b) { return _mm_add_ps(a, b); }
+static inline dsp_f4 dsp_f4_sub(dsp_f4 a, dsp_f4 b) { return _mm_sub_ps(a, b); }
+static inline dsp_f4 dsp_f4_mul(dsp_f4 a, dsp_f4 b) { return _mm_mul_ps(a, b); }
+static inline dsp_f4 dsp_f4_div(dsp_f4 a, dsp_f4 b) { return _mm_div_ps(a, b); }
+static inline dsp_f4 dsp_f4_min(dsp_f4 a, dsp_f4 b) { return _mm_min_ps(a, b); }
+static inline dsp_f4 dsp_f4_max(dsp_f4 a, dsp_f4 b) { return _mm_max_ps(a, b); }
+
+static inline dsp_f4 dsp_f4_abs(dsp_f4 a) {
+    return _mm_andnot_ps(_mm_set1_ps(-0.0f), a);
+}
+
+// a < b ? x : y, per lane.
+static inline dsp_f4 dsp_f4_select_lt(dsp_f4 a, dsp_f4 b, dsp_f4 x, dsp_f4 y) {
+    __m128 m = _mm_cmplt_ps(a, b);
+    return _mm_or_ps(_mm_and_ps(m, x), _mm_andnot_ps(m, y));
+}
+
+// floorf() per lane. SSE2 has no rounding instruction, so truncate and step
+// down where truncation rounded up; values of 2^23 and above are integers.
+static inline dsp_f4 dsp_f4_floor(dsp_f4 a) {
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+    t = _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.0f)));
+    __m128 small = _mm_cmplt_ps(dsp_f4_abs(a), _mm_set1_ps(8388608.0f));
+    return _mm_or_ps(_mm_and_ps(small, t), _mm_andnot_ps(small, a));
+}
+
+// Double-precision lanes for the transcendental cores: four per register
+// with AVX2, two with SSE2.
+#if defined(DSP_SIMD_AVX2)
+typedef __m256d dsp_dv;
+#define DSP_DV_LANES 4
+static inline dsp_dv dsp_dv_set1(double x) { return _mm256_set1_pd(x); }
+static inline dsp_dv dsp_dv_add(dsp_dv a, dsp_dv b) { return _mm256_add_pd(a, b); }
+static inline dsp_dv dsp_dv_sub(dsp_dv a, dsp_dv b) { return _mm256_sub_pd(a, b); }
+static inline dsp_dv dsp_dv_mul(dsp_dv a, dsp_dv b) { return _mm256_mul_pd(a, b); }
+static inline dsp_dv dsp_dv_div(dsp_dv a, dsp_dv b) { return _mm256_div_pd(a, b); }
+static inline dsp_dv dsp_dv_min(dsp_dv a, dsp_dv b) { return _mm256_min_pd(a, b); }
+static inline dsp_dv dsp_dv_max(dsp_dv a, dsp_dv b) { return _mm256_max_pd(a, b); }
+static inline dsp_dv dsp_dv_and(dsp_dv a, dsp_dv b) { return _mm256_and_pd(a, b); }
+static inline dsp_dv dsp_dv_or(dsp_dv a, dsp_dv b) { return _mm256_or_pd(a, b); }
+static inline dsp_dv dsp_dv_xor(dsp_dv a, dsp_dv b) { return _mm256_xor_pd(a, b); }
+static inline dsp_dv dsp_dv_gt(dsp_dv a, dsp_dv b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+static inline dsp_dv dsp_dv_lt(dsp_dv a, dsp_dv b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+static inline dsp_dv dsp_dv_select(dsp_dv m, dsp_dv x, dsp_dv y) { return _mm256_blendv_pd(y, x, m); }
+static inline dsp_dv dsp_dv_shl_bits(dsp_dv a, int n) {
+    return _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_castpd_si256(a), n));
+}
+static inline dsp_dv dsp_dv_add_bits(dsp_dv a, int64_t n) {
+    return _mm256_castsi256_pd(_mm256_add_epi64(_mm256_castpd_si256(a), _mm256_set1_epi64x(n)));
+}
+#else
+typedef __m128d dsp_dv;
+#define DSP_DV_LANES 2
+static inline dsp_dv dsp_dv_set1(double x) { return _mm_set1_pd(x); }
+static inline dsp_dv dsp_dv_add(dsp_dv a, dsp_dv b) { return _mm_add_pd(a, b); }
+static inline dsp_dv dsp_dv_sub(dsp_dv a, dsp_dv b) { return _mm_sub_pd(a, b); }
+static inline dsp_dv dsp_dv_mul(dsp_dv a, dsp_dv b) { return _mm_mul_pd(a, b); }
+static inline dsp_dv dsp_dv_div(dsp_dv a, dsp_dv b) { return _mm_div_pd(a, b); }
+static inline dsp_dv dsp_dv_min(dsp_dv a, dsp_dv b) { return _mm_min_pd(a, b); }
+static inline dsp_dv dsp_dv_max(dsp_dv a, dsp_dv b) { return _mm_max_pd(a, b); }
+static inline dsp_dv dsp_dv_and(dsp_dv a, dsp_dv b) { return _mm_and_pd(a, b); }
+static inline dsp_dv dsp_dv_or(dsp_dv a, dsp_dv b) { return _mm_or_pd(a, b); }
+static inline dsp_dv dsp_dv_xor(dsp_dv a, dsp_dv b) { return _mm_xor_pd(a, b); }
+static inline dsp_dv dsp_dv_gt(dsp_dv a, dsp_dv b) { return _mm_cmpgt_pd(a, b); }
+static inline dsp_dv dsp_dv_lt(dsp_dv a, dsp_dv b) { return _mm_cmplt_pd(a, b); }
+static inline dsp_dv dsp_dv_select(dsp_dv m, dsp_dv x, dsp_dv y) {
+    return _mm_or_pd(_mm_and_pd(m, x), _mm_andnot_pd(m, y));
+}
+static inline dsp_dv dsp_dv_shl_bits(dsp_dv a, int n) {
+    return _mm_castsi128_pd(_mm_slli_epi64(_mm_castpd_si128(a), n));
+}
+static inline dsp_dv dsp_dv_add_bits(dsp_dv a, int64_t n) {
+    return _mm_castsi128_pd(_mm_add_epi64(_mm_castpd_si128(a), _mm_set1_epi64x(n)));
+}
+#endif
+
+// Adding 1.5 * 2^52 rounds |x| < 2^51 to the nearest integer (ties to even,
+// like nearbyint) and leaves that integer in the low mantissa bits.
+#define DSP_ROUND_MAGIC 6755399441055744.0
+
+// dsp_exp_d() per lane for |x| < 700, where ldexp() is an exact multiply.
+static inline dsp_dv dsp_dv_exp(dsp_dv x) {
+    dsp_dv magic = dsp_dv_set1(DSP_ROUND_MAGIC);
+    dsp_dv m = dsp_dv_add(dsp_dv_mul(x, dsp_dv_set1(DSP_LOG2E)), magic);
+    dsp_dv k = dsp_dv_sub(m, magic);
+    dsp_dv r = dsp_dv_sub(dsp_dv_sub(x, dsp_dv_mul(k, dsp_dv_set1(DSP_LN2_HI))),
+                          dsp_dv_mul(k, dsp_dv_set1(DSP_LN2_LO)));
+    dsp_dv p = dsp_dv_set1(1.0 / 479001600.0);
+    p = dsp_dv_add(dsp_dv_mul(p, r), dsp_dv_set1(1.0 / 39916800.0));
+    p = dsp_dv_add(dsp_dv_mul(p, r), dsp_dv_set1(1.0 / 3628800.0));
+    p = dsp_dv_add(dsp_dv_mul(p, r), dsp_dv_set1(1.0 / 362880.0));
+    p = dsp_dv_add(dsp_dv_mul(p, r), dsp_dv_set1(1.0 / 40320.0));
+    p = dsp_dv_add(dsp_dv_mul(p, r), dsp_dv_set1(1.0 / 5040.0));
+    p = dsp_dv_add(dsp_dv_mul(p, r), dsp_dv_set1(1.0 / 720.0));
+    p = dsp_dv_add(dsp_dv_mul(p, r), dsp_dv_set1(1.0 / 120.0));
+    p = dsp_dv_add(dsp_dv_mul(p, r), dsp_dv_set1(1.0 / 24.0));
+    p = dsp_dv_add(dsp_dv_mul(p, r), dsp_dv_set1(1.0 / 6.0));
+    p = dsp_dv_add(dsp_dv_mul(p, r), dsp_dv_set1(0.5));
+    p = dsp_dv_add(dsp_dv_mul(p, r), dsp_dv_set1(1.0));
+    p = dsp_dv_add(dsp_dv_mul(p, r), dsp_dv_set1(1.0));
+    // 2^k: biased exponent k + 1023 shifted into place.
+    dsp_dv scale = dsp_dv_shl_bits(dsp_dv_add_bits(m, 1023), 52);
+    return dsp_dv_mul(p, scale);
+}
+
+// dsp_tanhf() per lane, on widened floats.
+static inline dsp_dv dsp_dv_tanh(dsp_dv x) {
+    dsp_dv sign_bit = dsp_dv_set1(-0.0);
+    dsp_dv ax = dsp_dv_xor(x, dsp_dv_and(x, sign_bit));
+    dsp_dv x2 = dsp_dv_mul(x, x);
+    dsp_dv series = dsp_dv_add(dsp_dv_sub(x, dsp_dv_mul(dsp_dv_mul(x, x2), dsp_dv_set1(1.0 / 3.0))),
+                               dsp_dv_mul(dsp_dv_mul(dsp_dv_mul(x, x2), x2), dsp_dv_set1(2.0 / 15.0)));
+    dsp_dv limit = dsp_dv_set1(9.5);
+    // Operand order keeps NaN lanes NaN (min/max return the second operand
+    // when either is NaN), matching the scalar path once a filter blows up.
+    dsp_dv clamped = dsp_dv_max(dsp_dv_set1(-9.5), dsp_dv_min(limit, x));
+    dsp_dv e = dsp_dv_exp(dsp_dv_mul(dsp_dv_set1(2.0), clamped));
+    dsp_dv one = dsp_dv_set1(1.0);
+    dsp_dv y = dsp_dv_div(dsp_dv_sub(e, one), dsp_dv_add(e, one));
+    y = dsp_dv_select(dsp_dv_lt(ax, dsp_dv_set1(1e-3)), series, y);
+    dsp_dv saturated = dsp_dv_or(one, dsp_dv_and(x, sign_bit));
+    return dsp_dv_select(dsp_dv_gt(ax, limit), saturated, y);
+}
+
+#if defined(DSP_SIMD_AVX2)
+static inline dsp_f4 dsp_f4_tanh(dsp_f4 x) {
+    return _mm256_cvtpd_ps(dsp_dv_tanh(_mm256_cvtps_pd(x)));
+}
+#else
+static inline dsp_f4 dsp_f4_tanh(dsp_f4 x) {
+    __m128 lo = _mm_cvtpd_ps(dsp_dv_tanh(_mm_cvtps_pd(x)));
+    __m128 hi = _mm_cvtpd_ps(dsp_dv_tanh(_mm_cvtps_pd(_mm_movehl_ps(x, x))));
+    return _mm_movelh_ps(lo, hi);
+}
+#endif
+
+// dsp_sin_phase() per lane, for four aligned phases.
+static inline dsp_f4 dsp_f4_sin_phase_v(__m128i ph) {
+    __m128i idx = _mm_srli_epi32(ph, DSP_SINE_FRAC_BITS);
+    __m128i frac_bits = _mm_and_si128(ph, _mm_set1_epi32((1 << DSP_SINE_FRAC_BITS) - 1));
+    __m128 frac = _mm_mul_ps(_mm_cvtepi32_ps(frac_bits), _mm_set1_ps(1.0f / (float)(1u << DSP_SINE_FRAC_BITS)));
+#if defined(DSP_SIMD_AVX2)
+    __m128 a = _mm_i32gather_ps(dsp_sine_table, idx, 4);
+    __m128 b = _mm_i32gather_ps(dsp_sine_table + 1, idx, 4);
+#else
+    _Alignas(16) uint32_t i[4];
+    _mm_store_si128((__m128i *)i, idx);
+    __m128 a = _mm_setr_ps(dsp_sine_table[i[0]], dsp_sine_table[i[1]], dsp_sine_table[i[2]], dsp_sine_table[i[3]]);
+    __m128 b = _mm_setr_ps(dsp_sine_table[i[0] + 1], dsp_sine_table[i[1] + 1],
+                           dsp_sine_table[i[2] + 1], dsp_sine_table[i[3] + 1]);
+#endif
+    return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), frac));
+}
+
+static inline dsp_f4 dsp_f4_sin_phase(const uint32_t *p) {
+    return dsp_f4_sin_phase_v(_mm_load_si128((const __m128i *)p));
+}
+
+// dsp_sin_turns() per lane, for 0 <= turns < 0.5 (filter coefficients).
+static inline dsp_f4 dsp_f4_sin_turns_half(dsp_f4 turns) {
+    return dsp_f4_sin_phase_v(_mm_cvttps_epi32(_mm_mul_ps(turns, _mm_set1_ps((float)DSP_PHASE_ONE))));
+}
+
+// dsp_saw_phase() per lane.
+static inline dsp_f4 dsp_f4_saw_phase(const uint32_t *p) {
+    __m128i ph = _mm_load_si128((const __m128i *)p);
+    return _mm_mul_ps(_mm_cvtepi32_ps(ph), _mm_set1_ps((float)(2.0 / DSP_PHASE_ONE)));
+}
+
+// 1 where phase < edge, -1 elsewhere (unsigned compare via sign flip).
+static inline dsp_f4 dsp_f4_pulse_phase(const uint32_t *p, uint32_t edge) {
+    __m128i flip = _mm_set1_epi32((int)0x80000000u);
+    __m128i ph = _mm_xor_si128(_mm_load_si128((const __m128i *)p), flip);
+    __m128i lim = _mm_xor_si128(_mm_set1_epi32((int)edge), flip);
+    __m128 below = _mm_castsi128_ps(_mm_cmplt_epi32(ph, lim));
+    return _mm_or_ps(_mm_and_ps(below, _mm_set1_ps(1.0f)), _mm_andnot_ps(below, _mm_set1_ps(-1.0f)));
+}
+
+#else
+
+// Scalar fallback: the same lane operations, one float at a time.
+typedef struct {
+    float v[DSP_F4_LANES];
+} dsp_f4;
+
+#define DSP_F4_MAP1(expr) \
+    dsp_f4 r; \
+    for (int l = 0; l < DSP_F4_LANES; l++) { r.v[l] = (expr); } \
+    return r
+
+static inline dsp_f4 dsp_f4_load(const float *p) { DSP_F4_MAP1(p[l]); }
+static inline void dsp_f4_store(float *p, dsp_f4 a) {
+    for (int l = 0; l < DSP_F4_LANES; l++) {
+        p[l] = a.v[l];
+    }
+}
+static inline dsp_f4 dsp_f4_set1(float x) { DSP_F4_MAP1(x); }
+static inline dsp_f4 dsp_f4_add(dsp_f4 a, dsp_f4 b) { DSP_F4_MAP1(a.v[l] + b.v[l]); }
+static inline dsp_f4 dsp_f4_sub(dsp_f4 a, dsp_f4 b) { DSP_F4_MAP1(a.v[l] - b.v[l]); }
+static inline dsp_f4 dsp_f4_mul(dsp_f4 a, dsp_f4 b) { DSP_F4_MAP1(a.v[l] * b.v[l]); }
+static inline dsp_f4 dsp_f4_div(dsp_f4 a, dsp_f4 b) { DSP_F4_MAP1(a.v[l] / b.v[l]); }
+static inline dsp_f4 dsp_f4_min(dsp_f4 a, dsp_f4 b) { DSP_F4_MAP1(fminf(a.v[l], b.v[l])); }
+static inline dsp_f4 dsp_f4_max(dsp_f4 a, dsp_f4 b) { DSP_F4_MAP1(fmaxf(a.v[l], b.v[l])); }
+static inline dsp_f4 dsp_f4_abs(dsp_f4 a) { DSP_F4_MAP1(fabsf(a.v[l])); }
+static inline dsp_f4 dsp_f4_select_lt(dsp_f4 a, dsp_f4 b, dsp_f4 x, dsp_f4 y) {
+    DSP_F4_MAP1(a.v[l] < b.v[l] ? x.v[l] : y.v[l]);
+}
+static inline dsp_f4 dsp_f4_floor(dsp_f4 a) { DSP_F4_MAP1(floorf(a.v[l])); }
+static inline dsp_f4 dsp_f4_tanh(dsp_f4 a) { DSP_F4_MAP1(dsp_tanhf(a.v[l])); }
+static inline dsp_f4 dsp_f4_sin_phase(const uint32_t *p) { DSP_F4_MAP1(dsp_sin_phase(p[l])); }
+static inline dsp_f4 dsp_f4_sin_turns_half(dsp_f4 a) { DSP_F4_MAP1(dsp_sin_turns(a.v[l])); }
+static inline dsp_f4 dsp_f4_saw_phase(const uint32_t *p) { DSP_F4_MAP1(dsp_saw_phase(p[l])); }
+static inline dsp_f4 dsp_f4_pulse_phase(const uint32_t *p, uint32_t edge) {
+    DSP_F4_MAP1(p[l] < edge ? 1.0f : -1.0f);
+}
+
+#undef DSP_F4_MAP1
+
+#endif
+
+#endif
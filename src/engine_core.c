@@ -0,0 +1,1528 @@
+#include "engine_core.h"
+#include "dsp_math.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int current_time_sig(const EngineProgram *prog, int *out_num, int *out_den) {
+    if (!prog || !out_num || !out_den) {
+        return 0;
+    }
+    if (prog->time_sig_seq_len > 0 && prog->time_sig_seq_num > 0 && prog->time_sig_seq_den > 0) {
+        *out_num = prog->time_sig_seq_num;
+        *out_den = prog->time_sig_seq_den;
+        return 1;
+    }
+    int section = prog->tempo_section;
+    if (section < 1 || section > 14) {
+        section = 1;
+    }
+    *out_num = prog->program.time_sig_num_map[section];
+    *out_den = prog->program.time_sig_den_map[section];
+    return 1;
+}
+
+static double bar_samples_for_sig(const EngineProgram *prog, int num, int den) {
+    if (!prog || num <= 0 || den <= 0 || prog->sample_rate <= 0.0 || prog->program.tempo <= 0.0f) {
+        return 0.0;
+    }
+    double sec_per_beat = 60.0 / (double)prog->program.tempo;
+    double whole_note = sec_per_beat * 4.0;
+    double bar_sec = whole_note * ((double)num / (double)den);
+    return bar_sec * prog->sample_rate;
+}
+
+static double current_bar_samples(const EngineProgram *prog) {
+    int num = 0;
+    int den = 0;
+    if (!current_time_sig(prog, &num, &den)) {
+        return 0.0;
+    }
+    return bar_samples_for_sig(prog, num, den);
+}
+
+static int effective_pattern_length(const EngineProgram *prog, const PatternDef *pattern) {
+    if (!prog || !pattern) {
+        return 0;
+    }
+    int len = pattern->length;
+    if (len <= 0) {
+        return 0;
+    }
+    if (!prog->program.time_sig_enforce && prog->time_sig_seq_len <= 0) {
+        return len;
+    }
+    int num = 0;
+    int den = 0;
+    if (prog->time_sig_seq_len > 0) {
+        num = prog->time_sig_seq_num;
+        den = prog->time_sig_seq_den;
+    } else {
+        int section = prog->tempo_section;
+        if (section < 1 || section > 14) {
+            section = 1;
+        }
+        num = prog->program.time_sig_num_map[section];
+        den = prog->program.time_sig_den_map[section];
+    }
+    if (num <= 0 || den <= 0) {
+        return len;
+    }
+    float steps_per_beat = 16.0f / (float)den;
+    int bar_steps = (int)lroundf((float)num * steps_per_beat);
+    if (bar_steps <= 0) {
+        return len;
+    }
+    int rem = len % bar_steps;
+    if (rem == 0) {
+        return len;
+    }
+    return len + (bar_steps - rem);
+}
+
+// Note-ons are queued by the sequencer pass and started by the voice pass at
+// the same frame, so voice allocation sees exactly the voices that are still
+// sounding at that point.
+static void queue_note(EngineState *engine, const TrackRuntime *track, float freq, int gate_samples, float amp_scale, int glide_samples, int accent) {
+    int t = (int)(track - engine->prog->tracks);
+    if (engine->track_mute[t] || (engine->solo_count > 0 && !engine->track_solo[t])) {
+        return;
+    }
+    if (engine->event_count >= ENGINE_MAX_EVENTS) {
+        engine->alloc.stats.drops++;
+        return;
+    }
+    NoteEvent *ev = &engine->events[engine->event_count++];
+    ev->frame = engine->event_frame;
+    ev->track = t;
+    ev->tmpl = track->tmpl;
+    ev->freq = freq;
+    ev->gate_samples = gate_samples;
+    ev->amp_scale = amp_scale;
+    ev->glide_samples = glide_samples;
+    ev->accent = accent;
+}
+
+static void start_note(EngineState *engine, const NoteEvent *ev) {
+    int v = voice_alloc_acquire(&engine->alloc, engine->voices, ev->track, engine->prog->program.steal_policy, engine->sample_rate);
+    if (v < 0) {
+        return;
+    }
+    voice_note_on(&engine->voices[v], ev->tmpl, ev->freq, ev->gate_samples, ev->amp_scale, ev->glide_samples, ev->accent);
+}
+
+// Drone synths were checked when the program was compiled.
+static void start_drones(EngineState *engine) {
+    EngineProgram *prog = engine->prog;
+    for (int d = 0; d < prog->program.drone_count; d++) {
+        DroneDef *drone = &prog->program.drones[d];
+        NoteEvent ev = {0};
+        ev.track = -1;
+        ev.tmpl = &prog->templates[dsl_find_synth(&prog->program, drone->synth)];
+        ev.freq = 440.0f * dsp_exp2f((drone->midi - 69.0f) / 12.0f);
+        ev.gate_samples = (int)(engine->sample_rate * 60.0); // long hold
+        ev.amp_scale = 0.6f;
+        start_note(engine, &ev);
+    }
+}
+
+static int track_cycle_steps(const EngineProgram *prog, const TrackRuntime *track, const PatternDef *pattern) {
+    if (!pattern) {
+        return 0;
+    }
+    int base_len = effective_pattern_length(prog, pattern);
+    if (track->palindrome && base_len > 1) {
+        base_len = base_len * 2 - 2;
+    }
+    if (track->iter > 1) {
+        base_len *= track->iter;
+    }
+    return base_len;
+}
+
+static const PatternDef *sequence_current_pattern(const EngineProgram *prog, TrackRuntime *track) {
+    if (!track->sequence || track->sequence->count == 0) {
+        return track->pattern;
+    }
+    if (track->seq_start > 0) {
+        if (track->seq_end < 0) {
+            track->seq_end = track->sequence->count;
+        }
+        int start = track->seq_start - 1;
+        int end = track->seq_end - 1;
+        if (track->seq_pos < start || track->seq_pos > end) {
+            return NULL;
+        }
+    }
+    const SequenceStep *step = &track->sequence->steps[track->seq_index];
+    int idx = dsl_find_pattern(&prog->program, step->pattern);
+    if (idx < 0) {
+        return NULL;
+    }
+    return &prog->program.patterns[idx];
+}
+
+static void update_track_tempo(EngineProgram *prog, TrackRuntime *track);
+static void update_all_track_tempos(EngineProgram *prog);
+static uint64_t hash_timing(const EngineProgram *prog);
+static uint64_t hash_drones(const EngineProgram *prog);
+
+static void advance_sequence(EngineState *engine, TrackRuntime *track) {
+    if (!track->sequence || track->sequence->count == 0) {
+        return;
+    }
+    const SequenceStep *step = &track->sequence->steps[track->seq_index];
+    track->seq_repeat_done++;
+    if (track->seq_repeat_done >= step->repeat) {
+        track->seq_repeat_done = 0;
+        track->seq_index = (track->seq_index + 1) % track->sequence->count;
+        track->seq_pos = (track->seq_pos + 1) % track->sequence->count;
+        engine->pattern_epoch++;
+        EngineProgram *prog = engine->prog;
+        if (track->is_tempo_leader) {
+            int max_section = track->sequence->count;
+            if (max_section < 1) max_section = 14;
+            prog->tempo_section = (track->seq_pos % max_section) + 1;
+            update_all_track_tempos(prog);
+            // The next step, and with it the new section, starts once this
+            // one has run its length.
+            prog->section_countdown = track->samples_per_step;
+        } else {
+            update_track_tempo(prog, track);
+        }
+    }
+}
+
+static void update_track_tempo(EngineProgram *prog, TrackRuntime *track) {
+    int idx = prog->tempo_section;
+    if (idx < 1 || idx > 14) {
+        return;
+    }
+    float map = prog->program.tempo_map[idx];
+    if (map <= 0.0f) {
+        map = 1.0f;
+    }
+    float mult = track->base_rate * map;
+    int sps = (int)((float)prog->base_samples_per_step / mult);
+    if (sps < 1) sps = 1;
+    track->samples_per_step = sps;
+}
+
+static void update_all_track_tempos(EngineProgram *prog) {
+    for (int i = 0; i < prog->track_count; i++) {
+        update_track_tempo(prog, &prog->tracks[i]);
+    }
+}
+
+static int track_active_for_sequence(TrackRuntime *track) {
+    if (!track->sequence || track->sequence->count == 0) {
+        return 1;
+    }
+    if (track->seq_start <= 0) {
+        return 1;
+    }
+    if (track->seq_end < 0) {
+        return 1;
+    }
+    int start = track->seq_start - 1;
+    int end = track->seq_end - 1;
+    return (track->seq_pos >= start && track->seq_pos <= end);
+}
+
+static void schedule_track_step(EngineState *engine, TrackRuntime *track) {
+    EngineProgram *prog = engine->prog;
+    if (!track_active_for_sequence(track)) {
+        if (track->sequence && track->sequence->count > 0) {
+            const PatternDef *p = sequence_current_pattern(prog, track);
+            if (p) {
+                int cycle_steps = track_cycle_steps(prog, track, p);
+                if (cycle_steps > 0) {
+                    track->step_index++;
+                    if (track->step_index >= cycle_steps) {
+                        track->step_index = 0;
+                        advance_sequence(engine, track);
+                    }
+                }
+            }
+        }
+        return;
+    }
+
+    const PatternDef *pattern = sequence_current_pattern(prog, track);
+    if (!pattern || pattern->length == 0) {
+        return;
+    }
+
+    int effective_len = effective_pattern_length(prog, pattern);
+    if (effective_len <= 0) {
+        return;
+    }
+
+    int step = track->step_index;
+    int base_step = step;
+    if (track->iter > 1) {
+        base_step = step / track->iter;
+    }
+
+    int idx = 0;
+    if (track->palindrome && effective_len > 1) {
+        int pal_len = effective_len * 2 - 2;
+        int p = base_step % pal_len;
+        if (p >= effective_len) {
+            p = pal_len - p;
+        }
+        idx = p;
+    } else {
+        idx = base_step % effective_len;
+    }
+
+    if (track->rev) {
+        idx = (effective_len - 1) - idx;
+    }
+
+    if (track->chunk > 0) {
+        int chunk_count = track->chunk;
+        if (chunk_count < 1) chunk_count = 1;
+        int chunk_size = (effective_len + chunk_count - 1) / chunk_count;
+        int cycle = (base_step / effective_len) % chunk_count;
+        int chunk_start = cycle * chunk_size;
+        int chunk_end = chunk_start + chunk_size - 1;
+        if (idx < chunk_start || idx > chunk_end) {
+            track->step_index++;
+            return;
+        }
+    }
+
+    int do_play = 1;
+    if (track->every > 1 && (step % track->every) != 0) {
+        do_play = 0;
+    }
+
+    if (do_play && track->density < 1.0f) {
+        track->rng ^= track->rng << 13;
+        track->rng ^= track->rng >> 17;
+        track->rng ^= track->rng << 5;
+        float r = (track->rng & 0xFFFFFF) / 16777215.0f;
+        if (r > track->density) {
+            do_play = 0;
+        }
+    }
+
+    if (do_play && idx < pattern->length) {
+        int note = pattern->notes[idx];
+        if (note >= 0) {
+            float cents = pattern->cents[idx];
+            float midi = (float)note + (cents / 100.0f);
+            if (track->rev && track->rev_transpose != 0) {
+                midi += (float)track->rev_transpose;
+            }
+            float freq = 440.0f * dsp_exp2f((midi - 69.0f) / 12.0f);
+            float slide_ms = track->slide_ms;
+            if (pattern->slide_ms[idx] >= 0.0f) {
+                slide_ms = pattern->slide_ms[idx];
+            }
+            int glide_samples = 0;
+            if (slide_ms > 0.0f) {
+                glide_samples = (int)(engine->sample_rate * (slide_ms / 1000.0f));
+            }
+            int accent = pattern->accent[idx];
+            if (!accent && track->accent_prob > 0.0f) {
+                track->rng ^= track->rng << 13;
+                track->rng ^= track->rng >> 17;
+                track->rng ^= track->rng << 5;
+                float r = (track->rng & 0xFFFFFF) / 16777215.0f;
+                if (r <= track->accent_prob) {
+                    accent = 1;
+                }
+            }
+            int gate = (int)(track->samples_per_step * 0.9f);
+            queue_note(engine, track, freq, gate, 1.0f, glide_samples, accent);
+
+            if (track->ornament_prob > 0.0f && pattern->degree_valid[idx]) {
+                track->rng ^= track->rng << 13;
+                track->rng ^= track->rng >> 17;
+                track->rng ^= track->rng << 5;
+                float r = (track->rng & 0xFFFFFF) / 16777215.0f;
+                if (r <= track->ornament_prob) {
+                    int deg = pattern->degree[idx];
+                    int oct = pattern->degree_octave[idx];
+                    int micro = pattern->degree_micro[idx];
+                    int grace_dir = -1;
+                    if (track->ornament_mode == 1) grace_dir = 1;
+                    else if (track->ornament_mode == 2) {
+                        grace_dir = track->ornament_alt ? 1 : -1;
+                        track->ornament_alt = !track->ornament_alt;
+                    }
+
+                    int grace_deg = deg + grace_dir;
+                    int grace_oct = oct;
+                    if (grace_deg < 1) {
+                        grace_deg = 7;
+                        grace_oct -= 1;
+                    } else if (grace_deg > 7) {
+                        grace_deg = 1;
+                        grace_oct += 1;
+                    }
+                    float grace_cents = prog->program.maqam_offsets[grace_deg - 1] + (micro * 50.0f);
+                    float grace_midi = prog->program.root_midi + grace_oct * 12 + (grace_cents / 100.0f);
+                    float grace_freq = 440.0f * dsp_exp2f((grace_midi - 69.0f) / 12.0f);
+
+                    int gate = (int)(track->samples_per_step * 0.2f);
+                    queue_note(engine, track, grace_freq, gate, 0.5f, 0, 0);
+                }
+            }
+
+            if (track->stut > 1) {
+                track->stut_remaining = track->stut - 1;
+                track->stut_samples_per = track->samples_per_step / track->stut;
+                if (track->stut_samples_per < 1) {
+                    track->stut_samples_per = 1;
+                }
+                track->stut_samples_until = track->stut_samples_per;
+                track->stut_freq = freq;
+            } else {
+                track->stut_remaining = 0;
+            }
+        }
+    }
+
+    track->step_index++;
+
+    int cycle_steps = track_cycle_steps(prog, track, pattern);
+    if (cycle_steps > 0 && track->step_index >= cycle_steps) {
+        track->step_index = 0;
+        if (track->sequence) {
+            advance_sequence(engine, track);
+        }
+    }
+}
+
+
+static void sequencer_tick(EngineState *engine) {
+    EngineProgram *prog = engine->prog;
+    if (prog->time_sig_seq_len > 0 && prog->time_sig_bar_samples > 0.0) {
+        prog->time_sig_bar_progress += 1.0;
+        while (prog->time_sig_bar_progress >= prog->time_sig_bar_samples) {
+            prog->time_sig_bar_progress -= prog->time_sig_bar_samples;
+            if (prog->time_sig_seq_index + 1 < prog->time_sig_seq_len) {
+                prog->time_sig_seq_index++;
+                prog->time_sig_seq_num = prog->program.time_sig_seq_num[prog->time_sig_seq_index];
+                prog->time_sig_seq_den = prog->program.time_sig_seq_den[prog->time_sig_seq_index];
+                prog->time_sig_bar_samples = bar_samples_for_sig(prog, prog->time_sig_seq_num, prog->time_sig_seq_den);
+            } else {
+                // Hold the last bar once the sequence ends.
+                prog->time_sig_bar_samples = bar_samples_for_sig(prog, prog->time_sig_seq_num, prog->time_sig_seq_den);
+                break;
+            }
+        }
+    }
+    for (int t = 0; t < prog->track_count; t++) {
+        TrackRuntime *track = &prog->tracks[t];
+        if (track->delay_samples > 0) {
+            track->delay_samples--;
+            continue;
+        }
+        if (track->samples_until_step <= 0) {
+            schedule_track_step(engine, track);
+            track->samples_until_step = track->samples_per_step;
+        }
+        track->samples_until_step--;
+
+        if (track->stut_remaining > 0) {
+            track->stut_samples_until--;
+            if (track->stut_samples_until <= 0) {
+                int gate = (int)(track->stut_samples_per * 0.8f);
+                queue_note(engine, track, track->stut_freq, gate, 1.0f, 0, 0);
+                track->stut_remaining--;
+                track->stut_samples_until = track->stut_samples_per;
+            }
+        }
+    }
+
+    prog->bar_pos += 1.0;
+    if (prog->bar_len > 0.0 && prog->bar_pos >= prog->bar_len) {
+        prog->bar_pos -= prog->bar_len;
+        prog->bar_len = current_bar_samples(prog);
+    }
+    if (prog->section_countdown >= 0) {
+        prog->section_countdown--;
+    }
+}
+
+// Whether the queued program may take over at the frame about to be ticked.
+static bool commit_due(const EngineState *engine) {
+    const EngineProgram *prog = engine->prog;
+    if (!prog) {
+        return true;
+    }
+    switch (engine->queued->program.commit_mode) {
+    case COMMIT_SECTION:
+        if (prog->has_tempo_leader) {
+            return prog->section_countdown == 0;
+        }
+        // No sequence to follow: fall back to bars.
+        // fallthrough
+    case COMMIT_BAR:
+        return prog->bar_len <= 0.0 || prog->bar_pos < 1.0;
+    case COMMIT_NOW:
+    default:
+        return true;
+    }
+}
+
+_Static_assert(ENGINE_CHUNK_FRAMES <= VOICE_BLOCK_FRAMES, "a voice span must fit one bank block");
+
+static void render_job(void *ctx, int j) {
+    EngineState *engine = (EngineState *)ctx;
+    int job = engine->jobs[j];
+    int frames = engine->job_frames;
+    if (job < 0) {
+        voice_bank_render(&engine->banks[-1 - job], engine->sample_rate, frames);
+        return;
+    }
+    float *out_l = engine->voice_out + (size_t)job * 2 * ENGINE_CHUNK_FRAMES;
+    float *out_r = out_l + ENGINE_CHUNK_FRAMES;
+    memset(out_l, 0, sizeof(float) * (size_t)frames);
+    memset(out_r, 0, sizeof(float) * (size_t)frames);
+    voice_render_block(&engine->voices[job], engine->sample_rate, out_l, out_r, frames);
+}
+
+// Each voice's stem: its track, or the one after the last track for drones.
+static int stem_of(const EngineState *engine, int v) {
+    int track = engine->alloc.track[v];
+    int tracks = engine->prog->track_count;
+    return (track >= 0 && track < tracks) ? track : tracks;
+}
+
+// Renders each bank and each unbanked voice on its own, on the pool when
+// there is one, voices into their voice_out span. Summing the spans in list
+// order adds the same values in the same order as rendering straight into
+// the mix, so the result is bit-identical to the serial path. Stem renders
+// add every voice to its stem as well.
+static void render_voice_spans(EngineState *engine, int bank_count, float *mix_l, float *mix_r, int offset, int frames) {
+    VoiceAllocator *alloc = &engine->alloc;
+    int *bank_of = engine->bank_of;
+    int job_count = 0;
+    for (int b = 0; b < bank_count; b++) {
+        if (engine->banks[b].lanes > 1) {
+            engine->jobs[job_count++] = -1 - b;
+        }
+    }
+    for (int v = alloc->head; v >= 0; v = alloc->next[v]) {
+        int b = bank_of[v];
+        if (b >= 0 && engine->banks[b].lanes > 1) {
+            continue;
+        }
+        // -2 marks a voice rendered into its own span this pass.
+        bank_of[v] = -1;
+        if (engine->voices[v].active) {
+            bank_of[v] = -2;
+            engine->jobs[job_count++] = v;
+        }
+    }
+
+    engine->job_frames = frames;
+    if (engine->pool && job_count > 1) {
+        render_pool_run(engine->pool, job_count, render_job, engine);
+    } else {
+        for (int j = 0; j < job_count; j++) {
+            render_job(engine, j);
+        }
+    }
+
+    mix_l += offset;
+    mix_r += offset;
+    for (int v = alloc->head; v >= 0; v = alloc->next[v]) {
+        int b = bank_of[v];
+        if (b < 0 && b != -2) {
+            continue;
+        }
+        float *stem_l = NULL;
+        float *stem_r = NULL;
+        if (engine->rendering_stems) {
+            stem_l = engine->stem_mix + (size_t)stem_of(engine, v) * 2 * ENGINE_CHUNK_FRAMES + offset;
+            stem_r = stem_l + ENGINE_CHUNK_FRAMES;
+        }
+        if (b >= 0) {
+            voice_bank_mix_lane(&engine->banks[b], engine->lane_of[v], mix_l, mix_r);
+            if (stem_l) {
+                voice_bank_mix_lane(&engine->banks[b], engine->lane_of[v], stem_l, stem_r);
+            }
+            continue;
+        }
+        const float *out_l = engine->voice_out + (size_t)v * 2 * ENGINE_CHUNK_FRAMES;
+        const float *out_r = out_l + ENGINE_CHUNK_FRAMES;
+        for (int i = 0; i < frames; i++) {
+            mix_l[i] += out_l[i];
+            mix_r[i] += out_r[i];
+        }
+        if (stem_l) {
+            for (int i = 0; i < frames; i++) {
+                stem_l[i] += out_l[i];
+                stem_r[i] += out_r[i];
+            }
+        }
+    }
+}
+
+// Renders every sounding voice into the mix, walking the allocator's list so
+// free slots cost nothing. Voices that can share a SIMD bank are grouped by
+// synth type and rendered first; the mix is then summed in list order either
+// way, so neither grouping nor the render threads change the output. The
+// span starts `offset` frames into the chunk's mix.
+static void render_voices(EngineState *engine, float *mix_l, float *mix_r, int offset, int frames) {
+    VoiceAllocator *alloc = &engine->alloc;
+    int *bank_of = engine->bank_of;
+    int *lane_of = engine->lane_of;
+    int bank_count = 0;
+
+    for (int v = alloc->head; v >= 0; v = alloc->next[v]) {
+        Voice *voice = &engine->voices[v];
+        bank_of[v] = -1;
+        if (!voice->active || !voice_bank_accepts(voice)) {
+            continue;
+        }
+        int b = 0;
+        while (b < bank_count && (engine->banks[b].voices[0]->type != voice->type ||
+                                  engine->banks[b].lanes == VOICE_BANK_LANES)) {
+            b++;
+        }
+        if (b == bank_count) {
+            if (bank_count == engine->max_banks) {
+                continue;
+            }
+            engine->banks[b].lanes = 0;
+            bank_count++;
+        }
+        VoiceBank *bank = &engine->banks[b];
+        bank_of[v] = b;
+        lane_of[v] = bank->lanes;
+        bank->voices[bank->lanes++] = voice;
+    }
+
+    if ((engine->pool && frames >= ENGINE_PARALLEL_MIN_FRAMES) || engine->rendering_stems) {
+        render_voice_spans(engine, bank_count, mix_l, mix_r, offset, frames);
+        voice_alloc_collect(alloc, engine->voices);
+        return;
+    }
+
+    mix_l += offset;
+    mix_r += offset;
+
+    for (int b = 0; b < bank_count; b++) {
+        VoiceBank *bank = &engine->banks[b];
+        if (bank->lanes > 1) {
+            voice_bank_render(bank, engine->sample_rate, frames);
+        }
+    }
+
+    for (int v = alloc->head; v >= 0; v = alloc->next[v]) {
+        int b = bank_of[v];
+        if (b >= 0 && engine->banks[b].lanes > 1) {
+            voice_bank_mix_lane(&engine->banks[b], lane_of[v], mix_l, mix_r);
+        } else if (engine->voices[v].active) {
+            voice_render_block(&engine->voices[v], engine->sample_rate, mix_l, mix_r, frames);
+        }
+    }
+    voice_alloc_collect(alloc, engine->voices);
+}
+
+// Pushes a program the audio thread has switched away from onto the retired
+// stack. The submitting thread only ever takes the whole stack, so a plain
+// compare-and-swap push is safe.
+static void retire_program(EngineState *engine, EngineProgram *prog) {
+    EngineProgram *head = atomic_load_explicit(&engine->retired, memory_order_relaxed);
+    do {
+        prog->next_retired = head;
+    } while (!atomic_compare_exchange_weak_explicit(&engine->retired, &head, prog, memory_order_release,
+                                                    memory_order_relaxed));
+}
+
+// Carries the sequencing position of an unchanged track over from the
+// program being replaced. Settings stay as compiled, and the step length is
+// worked out again from the new program's tempo.
+static void carry_track(TrackRuntime *track, const TrackRuntime *from) {
+    track->step_index = from->step_index;
+    track->samples_until_step = from->samples_until_step;
+    track->rng = from->rng;
+    track->stut_remaining = from->stut_remaining;
+    track->stut_samples_until = from->stut_samples_until;
+    track->stut_samples_per = from->stut_samples_per;
+    track->stut_freq = from->stut_freq;
+    track->seq_index = from->seq_index;
+    track->seq_repeat_left = from->seq_repeat_left;
+    track->seq_repeat_done = from->seq_repeat_done;
+    track->seq_end = from->seq_end;
+    track->seq_pos = from->seq_pos;
+    track->seq_cycle_active = from->seq_cycle_active;
+    track->ornament_alt = from->ornament_alt;
+    track->delay_samples = from->delay_samples;
+}
+
+// Audio thread: switches to `next`, keeping what did not change. Tracks are
+// matched by key; matched voices move to the new track index, and voices of
+// tracks that are gone fade out.
+static void switch_program(EngineState *engine, EngineProgram *next) {
+    EngineProgram *old = engine->prog;
+    int fade = (int)(engine->sample_rate * ENGINE_SWITCH_FADE_SECONDS);
+    bool keep_drones = false;
+    if (old) {
+        bool same_timing = old->timing_hash == next->timing_hash;
+        if (same_timing) {
+            next->tempo_section = old->tempo_section;
+            next->time_sig_seq_index = old->time_sig_seq_index;
+            next->time_sig_seq_num = old->time_sig_seq_num;
+            next->time_sig_seq_den = old->time_sig_seq_den;
+            next->time_sig_bar_samples = old->time_sig_bar_samples;
+            next->time_sig_bar_progress = old->time_sig_bar_progress;
+            next->bar_pos = old->bar_pos;
+            next->bar_len = old->bar_len;
+            next->section_countdown = old->section_countdown;
+        }
+
+        int map[DSL_MAX_TRACKS]; // old track -> new track, -1 if gone
+        for (int t = 0; t < old->track_count; t++) {
+            map[t] = -1;
+        }
+        for (int i = 0; i < next->track_count; i++) {
+            TrackRuntime *track = &next->tracks[i];
+            int from = -1;
+            for (int t = 0; t < old->track_count; t++) {
+                if (map[t] < 0 && old->tracks[t].key == track->key) {
+                    from = t;
+                    break;
+                }
+            }
+            if (from >= 0) {
+                map[from] = i;
+            }
+            if (from >= 0 && same_timing && old->tracks[from].def_hash == track->def_hash) {
+                carry_track(track, &old->tracks[from]);
+            }
+            if (same_timing) {
+                update_track_tempo(next, track);
+            }
+        }
+
+        // Sounding voices move to the new program's template for their synth,
+        // so controls keep reaching them.
+        int synth_map[DSL_MAX_SYNTHS];
+        for (int s = 0; s < old->program.synth_count; s++) {
+            synth_map[s] = dsl_find_synth(&next->program, old->program.synths[s].name);
+        }
+
+        keep_drones = old->drone_hash == next->drone_hash;
+        VoiceAllocator *alloc = &engine->alloc;
+        for (int v = alloc->head; v >= 0; v = alloc->next[v]) {
+            VoiceCold *cold = engine->voices[v].cold;
+            if (cold->tmpl) {
+                int s = synth_map[cold->tmpl - old->templates];
+                cold->tmpl = (s >= 0) ? &next->templates[s] : NULL;
+            }
+            int t = alloc->track[v];
+            if (t >= 0) {
+                alloc->track[v] = map[t];
+            }
+            if (t >= 0 ? map[t] < 0 : !keep_drones) {
+                voice_alloc_fade(alloc, engine->voices, v, fade);
+            }
+        }
+    }
+    engine->prog = next;
+    engine->smoother_count = 0;
+    engine->pattern_epoch++;
+    if (!keep_drones) {
+        start_drones(engine);
+    }
+    if (old) {
+        retire_program(engine, old);
+    }
+}
+
+static void set_base_step(EngineProgram *prog) {
+    prog->base_samples_per_step = (int)(prog->sample_rate * 60.0 / prog->program.tempo / 4.0);
+    if (prog->base_samples_per_step < 1) {
+        prog->base_samples_per_step = 1;
+    }
+}
+
+static bool param_is_smoothed(SynthParam param) {
+    return param == SYNTH_PARAM_AMP || param == SYNTH_PARAM_CUTOFF || param == SYNTH_PARAM_RES ||
+           param == SYNTH_PARAM_DRIVE || param == SYNTH_PARAM_EXCITE;
+}
+
+// Sets a synth parameter in the running program: new notes get it through the
+// rebuilt template, sounding notes of the synth follow smoothed params.
+static void apply_synth_param(EngineState *engine, int synth, SynthParam param, float value) {
+    EngineProgram *prog = engine->prog;
+    SynthDef *def = &prog->program.synths[synth];
+    float *field = dsl_synth_param_field(def, param);
+    *field = value;
+    VoiceTemplate *tmpl = &prog->templates[synth];
+    voice_template_init(tmpl, def, prog->sample_rate, prog->program.control_frames);
+    // Drones now differ from the compiled program's: a reload restarts them
+    // at the script's settings.
+    prog->drone_hash = hash_drones(prog);
+    if (!param_is_smoothed(param)) {
+        return;
+    }
+
+    // Comb voices take their level from excite, the rest from amp.
+    bool level = (def->type == SYNTH_COMB) ? param == SYNTH_PARAM_EXCITE : param == SYNTH_PARAM_AMP;
+    for (int v = engine->alloc.head; v >= 0; v = engine->alloc.next[v]) {
+        Voice *voice = &engine->voices[v];
+        if (voice->cold->tmpl != tmpl) {
+            continue;
+        }
+        if (param == SYNTH_PARAM_CUTOFF) {
+            voice->cutoff = value;
+        } else if (param == SYNTH_PARAM_RES) {
+            voice->res = value;
+        } else if (param == SYNTH_PARAM_DRIVE) {
+            voice->drive = value;
+        } else if (level) {
+            // From the note's own gain rather than by the ratio to the old
+            // level, which a level of 0 would lose.
+            voice->amp = value * voice->cold->amp_scale;
+        }
+    }
+}
+
+static void apply_tempo(EngineProgram *prog, float bpm) {
+    prog->program.tempo = bpm;
+    set_base_step(prog);
+    update_all_track_tempos(prog);
+    if (prog->time_sig_seq_len > 0) {
+        prog->time_sig_bar_samples = bar_samples_for_sig(prog, prog->time_sig_seq_num, prog->time_sig_seq_den);
+    }
+    prog->bar_len = current_bar_samples(prog);
+    // The timing now differs from the compiled program's: a reload only
+    // carries bar and step positions over if it asks for this tempo too.
+    prog->timing_hash = hash_timing(prog);
+}
+
+static void set_track_flag(bool *flags, int track, bool on, int *count) {
+    if (track < 0 || track >= DSL_MAX_TRACKS || flags[track] == on) {
+        return;
+    }
+    flags[track] = on;
+    if (count) {
+        *count += on ? 1 : -1;
+    }
+}
+
+// Audio thread: applies every queued control command. Smoothed params only
+// get a new target here; step_smoothers moves them.
+static void drain_controls(EngineState *engine) {
+    ControlCommand cmd;
+    while (control_ring_pop(&engine->controls, &cmd)) {
+        EngineProgram *prog = engine->prog;
+        switch (cmd.type) {
+        case CONTROL_PARAM: {
+            int synth = prog ? dsl_find_synth(&prog->program, cmd.synth) : -1;
+            if (synth < 0) {
+                break;
+            }
+            if (!param_is_smoothed(cmd.param)) {
+                apply_synth_param(engine, synth, cmd.param, cmd.value);
+                break;
+            }
+            int i = 0;
+            while (i < engine->smoother_count &&
+                   (engine->smoothers[i].synth != synth || engine->smoothers[i].param != cmd.param)) {
+                i++;
+            }
+            if (i == ENGINE_MAX_SMOOTHERS) {
+                apply_synth_param(engine, synth, cmd.param, cmd.value);
+                break;
+            }
+            if (i == engine->smoother_count) {
+                engine->smoother_count++;
+            }
+            engine->smoothers[i].synth = synth;
+            engine->smoothers[i].param = cmd.param;
+            engine->smoothers[i].target = cmd.value;
+            break;
+        }
+        case CONTROL_TEMPO:
+            if (prog && cmd.value > 0.0f) {
+                apply_tempo(prog, cmd.value);
+            }
+            break;
+        case CONTROL_MASTER:
+            // A program waiting for its commit point keeps the new gain too.
+            if (prog) {
+                prog->program.master_amp = cmd.value;
+            }
+            if (engine->queued) {
+                engine->queued->program.master_amp = cmd.value;
+            }
+            break;
+        case CONTROL_MUTE:
+            set_track_flag(engine->track_mute, cmd.track, cmd.value != 0.0f, NULL);
+            break;
+        case CONTROL_SOLO:
+            set_track_flag(engine->track_solo, cmd.track, cmd.value != 0.0f, &engine->solo_count);
+            break;
+        }
+    }
+}
+
+// Moves every smoothed param one chunk of `frames` towards its target,
+// dropping those that arrive.
+static void step_smoothers(EngineState *engine, int frames) {
+    if (engine->smoother_count == 0) {
+        return;
+    }
+    float k = 1.0f - dsp_expf(-(float)frames / (float)(ENGINE_CONTROL_SMOOTH_SECONDS * engine->sample_rate));
+    int i = 0;
+    while (i < engine->smoother_count) {
+        ParamSmoother *sm = &engine->smoothers[i];
+        float value = *dsl_synth_param_field(&engine->prog->program.synths[sm->synth], sm->param);
+        value += (sm->target - value) * k;
+        bool arrived = fabsf(sm->target - value) <= 1e-4f * fmaxf(1.0f, fabsf(sm->target));
+        apply_synth_param(engine, sm->synth, sm->param, arrived ? sm->target : value);
+        if (arrived) {
+            *sm = engine->smoothers[--engine->smoother_count];
+        } else {
+            i++;
+        }
+    }
+}
+
+// Audio thread: takes the newest submitted program into `queued`, dropping
+// one still waiting there, and switches to it once it is due.
+static void take_pending(EngineState *engine) {
+    EngineProgram *next = atomic_exchange_explicit(&engine->pending, NULL, memory_order_acquire);
+    if (next) {
+        if (engine->queued) {
+            retire_program(engine, engine->queued);
+        }
+        engine->queued = next;
+    }
+}
+
+static void commit_queued(EngineState *engine) {
+    if (engine->queued && commit_due(engine)) {
+        switch_program(engine, engine->queued);
+        engine->queued = NULL;
+    }
+}
+
+static float quantize(const EngineState *engine, float x) {
+    if (engine->bit_depth == 16) {
+        return floorf(x * 32767.0f) / 32767.0f;
+    }
+    if (engine->bit_depth == 24) {
+        return floorf(x * 8388607.0f) / 8388607.0f;
+    }
+    return x;
+}
+
+// engine_render, optionally also writing each track's share of the mix to
+// `stems` (see engine_render_stems).
+static void render_block(EngineState *engine, float *out_l, float *out_r, int stride, float *stems, int frames) {
+    take_pending(engine);
+    commit_queued(engine);
+    drain_controls(engine);
+    MeterRecord meter = {0};
+    meter.frame = engine->frames_rendered;
+    meter.frames = frames;
+    engine->frames_rendered += (unsigned long long)frames;
+    if (!engine->prog) {
+        for (int i = 0; i < frames; i++) {
+            out_l[i * stride] = 0.0f;
+            out_r[i * stride] = 0.0f;
+        }
+        meter_ring_push(&engine->meters, &meter);
+        return;
+    }
+
+    _Alignas(16) float mix_l[ENGINE_CHUNK_FRAMES];
+    _Alignas(16) float mix_r[ENGINE_CHUNK_FRAMES];
+    MeterAccum acc = {0};
+    engine->rendering_stems = stems != NULL;
+
+    int done = 0;
+    while (done < frames) {
+        int chunk = frames - done;
+        if (chunk > ENGINE_CHUNK_FRAMES) {
+            chunk = ENGINE_CHUNK_FRAMES;
+        }
+        commit_queued(engine);
+
+        // Sequencer pass: advance every track frame by frame and collect
+        // note-ons. Stops early if another frame could overflow the queue
+        // (each track emits at most a note, a grace note and a stutter), or
+        // at the frame a queued program takes over, so the next chunk starts
+        // with the switch.
+        int reserve = engine->prog->track_count * 3;
+        engine->event_count = 0;
+        int n = 0;
+        while (n < chunk && engine->event_count + reserve <= ENGINE_MAX_EVENTS) {
+            if (n > 0 && engine->queued && commit_due(engine)) {
+                break;
+            }
+            engine->event_frame = n;
+            sequencer_tick(engine);
+            n++;
+        }
+        chunk = n;
+
+        // Voice pass: render all voices up to the next note-on, start it, repeat.
+        memset(mix_l, 0, sizeof(float) * (size_t)chunk);
+        memset(mix_r, 0, sizeof(float) * (size_t)chunk);
+        int stem_count = stems ? engine_stem_count(engine) : 0;
+        if (stems) {
+            memset(engine->stem_mix, 0, sizeof(float) * 2 * ENGINE_CHUNK_FRAMES * (size_t)stem_count);
+        }
+        int pos = 0;
+        int e = 0;
+        while (pos < chunk) {
+            while (e < engine->event_count && engine->events[e].frame == pos) {
+                start_note(engine, &engine->events[e]);
+                e++;
+            }
+            int end = (e < engine->event_count) ? engine->events[e].frame : chunk;
+            render_voices(engine, mix_l, mix_r, pos, end - pos);
+            pos = end;
+        }
+
+        // The master gain glides linearly over the chunk towards where a
+        // one-pole smoother would be at its end.
+        float master = engine->master_gain;
+        float master_target = engine->prog->program.master_amp;
+        float master_step = 0.0f;
+        if (master != master_target) {
+            float k = 1.0f - dsp_expf(-(float)chunk / (float)(ENGINE_CONTROL_SMOOTH_SECONDS * engine->sample_rate));
+            float end = master + (master_target - master) * k;
+            if (fabsf(master_target - end) <= 1e-5f) {
+                end = master_target;
+            }
+            master_step = (end - master) / (float)chunk;
+            engine->master_gain = end;
+        }
+        for (int i = 0; i < chunk; i++) {
+            float gain = master + master_step * (float)i;
+            float l = quantize(engine, mix_l[i] * gain);
+            float r = quantize(engine, mix_r[i] * gain);
+            out_l[(done + i) * stride] = l;
+            out_r[(done + i) * stride] = r;
+            mix_l[i] = l;
+            mix_r[i] = r;
+        }
+        // Stems go through the same gain and quantization as the mix, each
+        // quantized on its own so it is a valid signal at that depth.
+        for (int st = 0; st < stem_count; st++) {
+            const float *stem_l = engine->stem_mix + (size_t)st * 2 * ENGINE_CHUNK_FRAMES;
+            const float *stem_r = stem_l + ENGINE_CHUNK_FRAMES;
+            float *dst = stems + ((size_t)done * (size_t)stem_count + (size_t)st) * 2;
+            for (int i = 0; i < chunk; i++) {
+                float gain = master + master_step * (float)i;
+                dst[0] = quantize(engine, stem_l[i] * gain);
+                dst[1] = quantize(engine, stem_r[i] * gain);
+                dst += 2 * stem_count;
+            }
+        }
+        // Meters run over the finished chunk, kept contiguous in mix_l/r.
+        meter_accumulate(&acc, mix_l, mix_r, chunk);
+        done += chunk;
+        step_smoothers(engine, chunk);
+    }
+
+    meter.rms_l = sqrtf(acc.sum_l / (float)frames);
+    meter.rms_r = sqrtf(acc.sum_r / (float)frames);
+    meter.peak_l = acc.peak_l;
+    meter.peak_r = acc.peak_r;
+    meter.clip = acc.peak_l > 1.0f || acc.peak_r > 1.0f;
+    meter_ring_push(&engine->meters, &meter);
+    engine->rendering_stems = false;
+}
+
+void engine_render(EngineState *engine, float *out_l, float *out_r, int stride, int frames) {
+    render_block(engine, out_l, out_r, stride, NULL, frames);
+}
+
+int engine_stem_count(const EngineState *engine) {
+    return engine->prog ? engine->prog->track_count + 1 : 0;
+}
+
+int engine_enable_stems(EngineState *engine, char *error, size_t error_len) {
+    if (engine->stem_mix) {
+        return 1;
+    }
+    engine->stem_mix = (float *)aligned_alloc(64, sizeof(float) * 2 * ENGINE_CHUNK_FRAMES * (DSL_MAX_TRACKS + 1));
+    if (!engine->stem_mix) {
+        snprintf(error, error_len, "Out of memory");
+        return 0;
+    }
+    return 1;
+}
+
+void engine_render_stems(EngineState *engine, float *out, float *stems, int frames) {
+    render_block(engine, out, out + 1, 2, stems, frames);
+}
+
+// FNV-1a over the parts of a program that decide whether a re-evaluated
+// track can keep its place. Fields are hashed one by one so stale bytes past
+// a name or pattern end never count.
+#define HASH_SEED 0xcbf29ce484222325ull
+
+static uint64_t hash_bytes(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ p[i]) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+static uint64_t hash_str(uint64_t h, const char *s) {
+    return hash_bytes(h, s, strlen(s) + 1);
+}
+
+static uint64_t hash_int(uint64_t h, int v) {
+    return hash_bytes(h, &v, sizeof(v));
+}
+
+static uint64_t hash_float(uint64_t h, float v) {
+    return hash_bytes(h, &v, sizeof(v));
+}
+
+static uint64_t hash_pattern(uint64_t h, const PatternDef *p) {
+    size_t n = (size_t)p->length;
+    h = hash_str(h, p->name);
+    h = hash_int(h, p->length);
+    h = hash_bytes(h, p->notes, sizeof(p->notes[0]) * n);
+    h = hash_bytes(h, p->cents, sizeof(p->cents[0]) * n);
+    h = hash_bytes(h, p->degree, sizeof(p->degree[0]) * n);
+    h = hash_bytes(h, p->degree_octave, sizeof(p->degree_octave[0]) * n);
+    h = hash_bytes(h, p->degree_micro, sizeof(p->degree_micro[0]) * n);
+    h = hash_bytes(h, p->degree_valid, sizeof(p->degree_valid[0]) * n);
+    h = hash_bytes(h, p->slide_ms, sizeof(p->slide_ms[0]) * n);
+    return hash_bytes(h, p->accent, sizeof(p->accent[0]) * n);
+}
+
+static uint64_t hash_synth(uint64_t h, const SynthDef *s) {
+    h = hash_str(h, s->name);
+    h = hash_int(h, (int)s->type);
+    h = hash_float(h, s->amp);
+    h = hash_float(h, s->cutoff);
+    h = hash_float(h, s->res);
+    h = hash_float(h, s->atk);
+    h = hash_float(h, s->dec);
+    h = hash_float(h, s->sus);
+    h = hash_float(h, s->rel);
+    h = hash_float(h, s->comb_feedback);
+    h = hash_float(h, s->comb_damp);
+    h = hash_float(h, s->comb_excite);
+    h = hash_float(h, s->detune_rate);
+    h = hash_float(h, s->detune_depth);
+    h = hash_float(h, s->drive);
+    h = hash_int(h, s->mod_count);
+    return hash_bytes(h, s->mods, sizeof(s->mods[0]) * (size_t)s->mod_count);
+}
+
+static uint64_t hash_timing(const EngineProgram *prog) {
+    const Program *p = &prog->program;
+    uint64_t h = HASH_SEED;
+    h = hash_bytes(h, &prog->sample_rate, sizeof(prog->sample_rate));
+    h = hash_int(h, prog->base_samples_per_step);
+    h = hash_float(h, p->tempo);
+    h = hash_bytes(h, p->tempo_map, sizeof(p->tempo_map));
+    h = hash_int(h, p->time_sig_num);
+    h = hash_int(h, p->time_sig_den);
+    h = hash_bytes(h, p->time_sig_num_map, sizeof(p->time_sig_num_map));
+    h = hash_bytes(h, p->time_sig_den_map, sizeof(p->time_sig_den_map));
+    h = hash_int(h, p->time_sig_enforce);
+    h = hash_int(h, p->time_sig_seq_len);
+    h = hash_bytes(h, p->time_sig_seq_num, sizeof(p->time_sig_seq_num[0]) * (size_t)p->time_sig_seq_len);
+    return hash_bytes(h, p->time_sig_seq_den, sizeof(p->time_sig_seq_den[0]) * (size_t)p->time_sig_seq_len);
+}
+
+static uint64_t hash_drones(const EngineProgram *prog) {
+    const Program *p = &prog->program;
+    uint64_t h = hash_bytes(HASH_SEED, &prog->sample_rate, sizeof(prog->sample_rate));
+    h = hash_int(h, p->control_frames);
+    h = hash_int(h, p->drone_count);
+    for (int d = 0; d < p->drone_count; d++) {
+        h = hash_float(h, p->drones[d].midi);
+        int synth = dsl_find_synth(p, p->drones[d].synth);
+        if (synth >= 0) {
+            h = hash_synth(h, &p->synths[synth]);
+        }
+    }
+    return h;
+}
+
+static uint64_t hash_track(const EngineProgram *prog, const TrackDef *t) {
+    const Program *p = &prog->program;
+    uint64_t h = prog->timing_hash;
+    h = hash_int(h, t->is_sequence);
+    h = hash_int(h, t->seq_start);
+    h = hash_int(h, t->seq_end);
+    h = hash_float(h, t->rate);
+    h = hash_float(h, t->hurry);
+    h = hash_int(h, t->fast);
+    h = hash_int(h, t->slow);
+    h = hash_int(h, t->every);
+    h = hash_float(h, t->density);
+    h = hash_int(h, t->rev);
+    h = hash_int(h, t->rev_transpose);
+    h = hash_int(h, t->palindrome);
+    h = hash_int(h, t->offset_bars);
+    h = hash_int(h, t->iter);
+    h = hash_int(h, t->chunk);
+    h = hash_int(h, t->stut);
+    h = hash_float(h, t->slide_ms);
+    h = hash_float(h, t->ornament_prob);
+    h = hash_int(h, t->ornament_mode);
+    h = hash_float(h, t->accent_prob);
+    if (t->is_sequence) {
+        const SequenceDef *seq = &p->sequences[dsl_find_sequence(p, t->pattern)];
+        h = hash_int(h, seq->count);
+        for (int s = 0; s < seq->count; s++) {
+            h = hash_int(h, seq->steps[s].repeat);
+            h = hash_pattern(h, &p->patterns[dsl_find_pattern(p, seq->steps[s].pattern)]);
+        }
+    } else {
+        h = hash_pattern(h, &p->patterns[dsl_find_pattern(p, t->pattern)]);
+    }
+    return h;
+}
+
+static uint64_t track_key(const TrackDef *t) {
+    uint64_t h = hash_int(HASH_SEED, t->is_sequence);
+    h = hash_str(h, t->pattern);
+    return hash_str(h, t->synth);
+}
+
+static int build_runtime(EngineProgram *prog) {
+    prog->track_count = 0;
+    int tempo_leader_set = 0;
+
+    for (int s = 0; s < prog->program.synth_count; s++) {
+        voice_template_init(&prog->templates[s], &prog->program.synths[s], prog->sample_rate,
+                            prog->program.control_frames);
+    }
+
+    for (int i = 0; i < prog->program.track_count; i++) {
+        TrackDef *track = &prog->program.tracks[i];
+        int pattern_idx = -1;
+        int sequence_idx = -1;
+        if (track->is_sequence) {
+            sequence_idx = dsl_find_sequence(&prog->program, track->pattern);
+            if (sequence_idx < 0) {
+                return 0;
+            }
+            const SequenceDef *seq = &prog->program.sequences[sequence_idx];
+            for (int s = 0; s < seq->count; s++) {
+                if (dsl_find_pattern(&prog->program, seq->steps[s].pattern) < 0) {
+                    return 0;
+                }
+            }
+        } else {
+            pattern_idx = dsl_find_pattern(&prog->program, track->pattern);
+            if (pattern_idx < 0) {
+                return 0;
+            }
+        }
+        int synth_idx = dsl_find_synth(&prog->program, track->synth);
+        if (synth_idx < 0) {
+            return 0;
+        }
+        TrackRuntime *runtime = &prog->tracks[prog->track_count++];
+        runtime->pattern = (pattern_idx >= 0) ? &prog->program.patterns[pattern_idx] : NULL;
+        runtime->synth = &prog->program.synths[synth_idx];
+        runtime->tmpl = &prog->templates[synth_idx];
+        runtime->sequence = (sequence_idx >= 0) ? &prog->program.sequences[sequence_idx] : NULL;
+        runtime->step_index = 0;
+        runtime->every = track->every;
+        runtime->rev = track->rev;
+        runtime->rev_transpose = track->rev_transpose;
+        runtime->palindrome = track->palindrome;
+        runtime->offset_bars = track->offset_bars;
+        runtime->iter = track->iter;
+        runtime->chunk = track->chunk;
+        runtime->stut = track->stut;
+        runtime->density = track->density;
+        runtime->rng = (uint32_t)(0x9E3779B9u + i * 2654435761u);
+        runtime->stut_remaining = 0;
+        runtime->stut_samples_until = 0;
+        runtime->stut_samples_per = 0;
+        runtime->stut_freq = 0.0f;
+        runtime->seq_index = 0;
+        runtime->seq_repeat_left = 0;
+        runtime->seq_repeat_done = 0;
+        runtime->seq_pos = 0;
+        runtime->slide_ms = track->slide_ms;
+        runtime->ornament_prob = track->ornament_prob;
+        runtime->ornament_mode = track->ornament_mode;
+        runtime->ornament_alt = 0;
+        runtime->accent_prob = track->accent_prob;
+        runtime->seq_start = track->seq_start;
+        runtime->seq_end = track->seq_end;
+        runtime->seq_pos = 0;
+        runtime->seq_cycle_active = 0;
+        runtime->is_tempo_leader = 0;
+
+        float mult = track->rate * track->hurry;
+        if (track->fast > 1) {
+            mult *= (float)track->fast;
+        }
+        if (track->slow > 1) {
+            mult /= (float)track->slow;
+        }
+        if (mult <= 0.001f) {
+            mult = 0.001f;
+        }
+
+        runtime->base_rate = mult;
+        runtime->samples_per_step = (int)((float)prog->base_samples_per_step / mult);
+        if (runtime->samples_per_step < 1) {
+            runtime->samples_per_step = 1;
+        }
+        runtime->samples_until_step = 0;
+        runtime->delay_samples = 0;
+
+        if (runtime->offset_bars > 0 && runtime->rev) {
+            int num = 0, den = 0;
+            if (current_time_sig(prog, &num, &den)) {
+                double bar_samples = bar_samples_for_sig(prog, num, den);
+                if (bar_samples > 0.0) {
+                    runtime->delay_samples = (int)(bar_samples * (double)runtime->offset_bars);
+                }
+            }
+        }
+
+        if (!tempo_leader_set && runtime->sequence && runtime->sequence->count > 0) {
+            runtime->is_tempo_leader = 1;
+            tempo_leader_set = 1;
+            prog->has_tempo_leader = 1;
+        }
+
+        update_track_tempo(prog, runtime);
+
+        // Repeats of the same pattern on the same synth are told apart by
+        // how many came before.
+        uint64_t key = track_key(track);
+        int repeat = 0;
+        for (int j = 0; j < i; j++) {
+            repeat += track_key(&prog->program.tracks[j]) == key;
+        }
+        runtime->key = hash_int(key, repeat);
+        runtime->def_hash = hash_track(prog, track);
+    }
+
+    return 1;
+}
+
+void engine_init(EngineState *engine) {
+    dsp_init_tables();
+    memset(engine, 0, sizeof(*engine));
+    engine->sample_rate = 48000.0;
+    engine->buffer_frames = 256;
+    engine->bit_depth = 32;
+    engine->prog = NULL;
+    engine->queued = NULL;
+    atomic_init(&engine->pending, NULL);
+    atomic_init(&engine->retired, NULL);
+    control_ring_init(&engine->controls);
+    meter_ring_init(&engine->meters);
+    engine->pattern_epoch = 0;
+    // No pool yet: nothing sounding, every note dropped.
+    engine->alloc.head = -1;
+    engine->alloc.tail = -1;
+}
+
+static void free_voice_pool(EngineState *engine) {
+    free(engine->voices);
+    free(engine->voice_cold);
+    free(engine->banks);
+    free(engine->bank_of);
+    free(engine->lane_of);
+    free(engine->voice_out);
+    free(engine->jobs);
+    voice_alloc_free(&engine->alloc);
+    delay_pool_free(&engine->delays);
+    engine->voices = NULL;
+    engine->voice_cold = NULL;
+    engine->banks = NULL;
+    engine->bank_of = NULL;
+    engine->lane_of = NULL;
+    engine->voice_out = NULL;
+    engine->jobs = NULL;
+    engine->voice_count = 0;
+    engine->voice_slots = 0;
+    engine->max_banks = 0;
+}
+
+// Frees the current, queued, pending and retired programs. Only safe while no audio
+// thread renders.
+static void free_programs(EngineState *engine) {
+    engine_collect_programs(engine);
+    engine_free_program(atomic_exchange_explicit(&engine->pending, NULL, memory_order_acquire));
+    engine_free_program(engine->queued);
+    engine_free_program(engine->prog);
+    engine->queued = NULL;
+    engine->prog = NULL;
+}
+
+void engine_free(EngineState *engine) {
+    render_pool_destroy(engine->pool);
+    engine->pool = NULL;
+    free(engine->stem_mix);
+    engine->stem_mix = NULL;
+    free_voice_pool(engine);
+    free_programs(engine);
+}
+
+int engine_set_voice_count(EngineState *engine, int voices, char *error, size_t error_len) {
+    if (voices == 0) {
+        voices = ENGINE_DEFAULT_VOICES;
+    }
+    if (voices < 1 || voices > ENGINE_MAX_VOICES) {
+        snprintf(error, error_len, "Voice count %d out of range (1-%d)", voices, ENGINE_MAX_VOICES);
+        return 0;
+    }
+    if (engine->voices && engine->voice_count == voices) {
+        return 1;
+    }
+    free_voice_pool(engine);
+
+    int slots = voice_alloc_slots(voices);
+    size_t pool_bytes = sizeof(Voice) * (size_t)slots; // a multiple of the alignment
+    engine->voices = (Voice *)aligned_alloc(_Alignof(Voice), pool_bytes);
+    engine->voice_cold = (VoiceCold *)calloc((size_t)slots, sizeof(VoiceCold));
+    engine->max_banks = slots / VOICE_BANK_LANES + 6;
+    engine->banks = (VoiceBank *)calloc((size_t)engine->max_banks, sizeof(VoiceBank));
+    engine->bank_of = (int *)calloc((size_t)slots, sizeof(int));
+    engine->lane_of = (int *)calloc((size_t)slots, sizeof(int));
+    engine->voice_out = (float *)aligned_alloc(64, sizeof(float) * 2 * ENGINE_CHUNK_FRAMES * (size_t)slots);
+    engine->jobs = (int *)calloc((size_t)(slots + engine->max_banks), sizeof(int));
+    if (!engine->voices || !engine->voice_cold || !engine->banks || !engine->bank_of || !engine->lane_of ||
+        !engine->voice_out || !engine->jobs ||
+        !voice_alloc_init(&engine->alloc, voices) || !delay_pool_init(&engine->delays, slots)) {
+        free_voice_pool(engine);
+        snprintf(error, error_len, "Out of memory for %d voices", voices);
+        return 0;
+    }
+    memset(engine->voices, 0, pool_bytes);
+    for (int i = 0; i < slots; i++) {
+        engine->voices[i].rng = (uint32_t)(0x12345678u + i * 1117u);
+        engine->voices[i].stage = ENV_OFF;
+        engine->voices[i].cold = &engine->voice_cold[i];
+        engine->voice_cold[i].delays = &engine->delays;
+    }
+    engine->voice_count = voices;
+    engine->voice_slots = slots;
+    return 1;
+}
+
+int engine_set_render_threads(EngineState *engine, int threads, char *error, size_t error_len) {
+    if (threads < 1 || threads > ENGINE_MAX_RENDER_THREADS) {
+        snprintf(error, error_len, "Render thread count %d out of range (1-%d)", threads, ENGINE_MAX_RENDER_THREADS);
+        return 0;
+    }
+    if (render_pool_threads(engine->pool) == threads) {
+        return 1;
+    }
+    render_pool_destroy(engine->pool);
+    engine->pool = NULL;
+    if (threads == 1) {
+        return 1;
+    }
+    engine->pool = render_pool_create(threads);
+    if (!engine->pool) {
+        snprintf(error, error_len, "Could not start %d render threads", threads);
+        return 0;
+    }
+    return 1;
+}
+
+EngineProgram *engine_compile_program(const EngineState *engine, const Program *program, char *error, size_t error_len) {
+    EngineProgram *prog = (EngineProgram *)aligned_alloc(_Alignof(EngineProgram), sizeof(EngineProgram));
+    if (!prog) {
+        snprintf(error, error_len, "Out of memory");
+        return NULL;
+    }
+    memset(prog, 0, sizeof(*prog));
+    prog->program = *program;
+    prog->sample_rate = engine->sample_rate;
+    prog->tempo_section = 1;
+    set_base_step(prog);
+    prog->time_sig_seq_len = prog->program.time_sig_seq_len;
+    if (prog->time_sig_seq_len > 0) {
+        prog->time_sig_seq_num = prog->program.time_sig_seq_num[0];
+        prog->time_sig_seq_den = prog->program.time_sig_seq_den[0];
+        prog->time_sig_bar_samples = bar_samples_for_sig(prog, prog->time_sig_seq_num, prog->time_sig_seq_den);
+    }
+    prog->bar_len = current_bar_samples(prog);
+    prog->section_countdown = -1;
+    prog->timing_hash = hash_timing(prog);
+    if (!build_runtime(prog)) {
+        engine_free_program(prog);
+        snprintf(error, error_len, "Play command references missing synth or pattern");
+        return NULL;
+    }
+    for (int d = 0; d < prog->program.drone_count; d++) {
+        if (dsl_find_synth(&prog->program, prog->program.drones[d].synth) < 0) {
+            snprintf(error, error_len, "Drone references missing synth '%s'", prog->program.drones[d].synth);
+            engine_free_program(prog);
+            return NULL;
+        }
+    }
+    prog->drone_hash = hash_drones(prog);
+    return prog;
+}
+
+void engine_free_program(EngineProgram *prog) {
+    free(prog);
+}
+
+int engine_load_program(EngineState *engine, const Program *program, char *error, size_t error_len) {
+    EngineProgram *prog = engine_compile_program(engine, program, error, error_len);
+    if (!prog) {
+        return 0;
+    }
+    free_programs(engine);
+    engine->prog = prog;
+    engine->master_gain = prog->program.master_amp;
+    engine->smoother_count = 0;
+
+    for (int i = 0; i < engine->voice_slots; i++) {
+        engine->voices[i].active = false;
+        engine->voices[i].env = 0.0f;
+        engine->voices[i].stage = ENV_OFF;
+        engine->voice_cold[i].comb_buf = NULL;
+    }
+    if (engine->voices) {
+        voice_alloc_reset(&engine->alloc);
+        delay_pool_reset(&engine->delays);
+    }
+    start_drones(engine);
+    return 1;
+}
+
+void engine_submit_program(EngineState *engine, EngineProgram *prog) {
+    engine_free_program(atomic_exchange_explicit(&engine->pending, prog, memory_order_acq_rel));
+}
+
+int engine_read_meters(EngineState *engine, MeterRecord *out, int max) {
+    return meter_ring_read(&engine->meters, out, max);
+}
+
+int engine_send_control(EngineState *engine, const ControlCommand *cmd) {
+    return control_ring_push(&engine->controls, cmd) ? 1 : 0;
+}
+
+void engine_collect_programs(EngineState *engine) {
+    EngineProgram *prog = atomic_exchange_explicit(&engine->retired, NULL, memory_order_acquire);
+    while (prog) {
+        EngineProgram *next = prog->next_retired;
+        engine_free_program(prog);
+        prog = next;
+    }
+}
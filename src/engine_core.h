@@ -0,0 +1,283 @@
+#ifndef ENGINE_CORE_H
+#define ENGINE_CORE_H
+
+#include "control_ring.h"
+#include "dsl.h"
+#include "meter_ring.h"
+#include "render_pool.h"
+#include "voice.h"
+#include "voice_alloc.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Platform-free synthesis and sequencing core. Knows nothing about audio
+// devices or files: callers feed it a parsed Program and pull rendered frames.
+
+// Raise whenever a change makes the same program and settings render
+// different samples; render caches key on it.
+#define ENGINE_RENDER_VERSION 1
+#define ENGINE_DEFAULT_VOICES 32
+#define ENGINE_MAX_VOICES DSL_MAX_VOICES
+#define ENGINE_CHUNK_FRAMES 256
+#define ENGINE_MAX_EVENTS 1024
+#define ENGINE_SWITCH_FADE_SECONDS 0.02
+// Controls glide to new amp, cutoff, res, drive, excite and master values
+// with this time constant; other params take effect on the next note.
+#define ENGINE_CONTROL_SMOOTH_SECONDS 0.01
+#define ENGINE_MAX_SMOOTHERS 64
+#define ENGINE_MAX_RENDER_THREADS 16
+// Spans shorter than this render on the audio thread alone: waking the pool
+// would cost more than it saves.
+#define ENGINE_PARALLEL_MIN_FRAMES 32
+
+// A note-on produced by the sequencer, started at `frame` within the chunk.
+typedef struct {
+    int frame;
+    int track; // index into EngineState.tracks, -1 for drones
+    const VoiceTemplate *tmpl;
+    float freq;
+    int gate_samples;
+    float amp_scale;
+    int glide_samples;
+    int accent;
+} NoteEvent;
+
+// A synth parameter gliding towards a value set through the control ring. The
+// current value lives in the program's SynthDef.
+typedef struct {
+    int synth;
+    SynthParam param;
+    float target;
+} ParamSmoother;
+
+typedef struct {
+    const PatternDef *pattern;
+    const SynthDef *synth;
+    const VoiceTemplate *tmpl;
+    const SequenceDef *sequence;
+    int step_index;
+    int samples_until_step;
+    int samples_per_step;
+    int every;
+    int rev;
+    int rev_transpose;
+    int palindrome;
+    int offset_bars;
+    int iter;
+    int chunk;
+    int stut;
+    float density;
+    uint32_t rng;
+    int stut_remaining;
+    int stut_samples_until;
+    int stut_samples_per;
+    float stut_freq;
+    int seq_index;
+    int seq_repeat_left;
+    int seq_repeat_done;
+    float slide_ms;
+    float ornament_prob;
+    int ornament_mode;
+    int ornament_alt;
+    float accent_prob;
+    int seq_start;
+    int seq_end;
+    int seq_pos;
+    int seq_cycle_active;
+    float base_rate;
+    int is_tempo_leader;
+    int delay_samples;
+
+    // Re-evaluation: `key` names the track (pattern, synth and how many
+    // earlier tracks share them), `def_hash` covers everything that decides
+    // when and what it plays. A track whose key and def_hash match the
+    // running program's takes over its position instead of restarting.
+    uint64_t key;
+    uint64_t def_hash;
+} TrackRuntime;
+
+// A Program compiled for one engine: the track runtimes, voice templates and
+// sequencer position that engine_render plays from. Built off the audio
+// thread by engine_compile_program; once submitted, the audio thread owns it
+// until it hands it back through EngineState.retired.
+typedef struct EngineProgram {
+    Program program;
+    VoiceTemplate templates[DSL_MAX_SYNTHS];
+    TrackRuntime tracks[DSL_MAX_TRACKS];
+    int track_count;
+    double sample_rate; // the rate templates and step lengths were built for
+
+    int base_samples_per_step;
+    int tempo_section;
+    int time_sig_seq_len;
+    int time_sig_seq_index;
+    int time_sig_seq_num;
+    int time_sig_seq_den;
+    double time_sig_bar_samples;
+    double time_sig_bar_progress;
+
+    // Where the next program may take over. bar_pos counts frames into the
+    // current bar of bar_len frames; section_countdown counts down to the
+    // first step after the tempo leader's sequence moves on (-1 when not
+    // counting).
+    double bar_pos;
+    double bar_len;
+    int section_countdown;
+    int has_tempo_leader;
+
+    uint64_t timing_hash; // tempo, tempo map and time signatures
+    uint64_t drone_hash;  // drones and their synths
+
+    struct EngineProgram *next_retired;
+} EngineProgram;
+
+typedef struct {
+    double sample_rate;
+    int buffer_frames;
+    int bit_depth;
+
+    // The program being played, NULL until one is loaded. While the audio
+    // thread renders, new programs arrive through `pending` and replaced ones
+    // leave through `retired`, a stack linked by next_retired. The audio
+    // thread holds an arrived program in `queued` until its commit point.
+    EngineProgram *prog;
+    EngineProgram *queued;
+    _Atomic(EngineProgram *) pending;
+    _Atomic(EngineProgram *) retired;
+
+    // Voice pool, sized by engine_set_voice_count. `alloc` hands out slots
+    // and keeps the list of sounding voices. voice_cold[i] is voices[i].cold.
+    Voice *voices;
+    VoiceCold *voice_cold;
+    int voice_count;
+    int voice_slots;
+    VoiceAllocator alloc;
+    DelayPool delays; // comb and PM delay lines, one per slot at most
+    // Enough banks for every voice: full banks plus one partial bank per
+    // bankable synth type.
+    VoiceBank *banks;
+    int max_banks;
+    int *bank_of; // per slot, scratch for render_voices
+    int *lane_of;
+
+    // Multi-core rendering, NULL for one thread. Banks and unbanked voices
+    // render as separate jobs, each voice into its own stereo span of
+    // voice_out; the audio thread then sums them in list order, so the mix
+    // is the same for any thread count.
+    RenderPool *pool;
+    float *voice_out; // per slot, 2 * ENGINE_CHUNK_FRAMES
+    int *jobs;        // slot, or -1 - bank
+    int job_frames;
+
+    // Stem renders: one stereo chunk per track plus one for drones, summed
+    // alongside the mix. NULL until engine_enable_stems.
+    float *stem_mix;
+    bool rendering_stems;
+
+    // Real-time controls, drained at the start of every engine_render. Mute
+    // and solo are by track index and outlive program switches; param and
+    // tempo changes last until the next program takes over.
+    ControlRing controls;
+    ParamSmoother smoothers[ENGINE_MAX_SMOOTHERS];
+    int smoother_count;
+    float master_gain; // glides towards prog->program.master_amp
+    bool track_mute[DSL_MAX_TRACKS];
+    bool track_solo[DSL_MAX_TRACKS];
+    int solo_count;
+
+    NoteEvent events[ENGINE_MAX_EVENTS];
+    int event_count;
+    int event_frame;
+
+    int base_samples_per_step;
+
+    // One record per engine_render call, for a single reader.
+    MeterRing meters;
+    unsigned long long frames_rendered;
+
+    unsigned long long pattern_epoch;
+} EngineState;
+
+// Resets the engine to defaults (48 kHz, 256-frame blocks, 32-bit output).
+// The engine has no voices until engine_set_voice_count is called.
+void engine_init(EngineState *engine);
+
+// Releases the voice pool, render threads and every program.
+void engine_free(EngineState *engine);
+
+// Sizes the voice pool for `voices` simultaneous notes (ENGINE_DEFAULT_VOICES
+// if 0). An existing pool of the same size is kept; otherwise it is replaced
+// by a new, silent one. Allocates, so call it outside the audio thread and
+// before engine_load_program. Returns 0 when the count is out of range or
+// memory runs out.
+int engine_set_voice_count(EngineState *engine, int voices, char *error, size_t error_len);
+
+// Renders voices on `threads` threads (1 to ENGINE_MAX_RENDER_THREADS), the
+// calling thread included. Starts or stops threads, so call it while no audio
+// thread renders. Output doesn't depend on the thread count. Returns 0 if
+// the threads could not be started, leaving the engine on one thread.
+int engine_set_render_threads(EngineState *engine, int threads, char *error, size_t error_len);
+
+// Compiles a parsed program at the engine's current sample rate without
+// touching what is playing. Allocates, so call it off the audio thread.
+// Returns NULL if a play command or drone references a missing synth, pattern
+// or sequence, or memory runs out.
+EngineProgram *engine_compile_program(const EngineState *engine, const Program *program, char *error, size_t error_len);
+void engine_free_program(EngineProgram *prog);
+
+// Compiles and installs a program while no audio thread is rendering,
+// silencing all voices, and starts its drones. Returns 0 as
+// engine_compile_program does.
+int engine_load_program(EngineState *engine, const Program *program, char *error, size_t error_len);
+
+// Hands a compiled program to a running audio thread, which switches to it
+// without stopping at the frame its commit mode picks: the start of the next
+// engine_render, or the next bar or section of the playing program. Tracks the old program
+// also had, unchanged, keep their step, sequence position and RNG; tracks
+// that changed start from their first step. Voices of tracks that are still
+// there ring on, the rest fade out over ENGINE_SWITCH_FADE_SECONDS, as do the
+// drones if they changed. A program submitted earlier that has not taken
+// over yet is dropped.
+void engine_submit_program(EngineState *engine, EngineProgram *prog);
+
+// Frees the programs the audio thread has switched away from. Call it from the
+// submitting thread, e.g. before each submit.
+void engine_collect_programs(EngineState *engine);
+
+// Queues a control command for the audio thread, which applies it at the start
+// of its next engine_render. Call it from a single control thread. Returns 0
+// if the ring is full.
+int engine_send_control(EngineState *engine, const ControlCommand *cmd);
+
+// Copies up to `max` unread meter records, oldest first. Call it from one
+// thread only. Returns the number copied.
+int engine_read_meters(EngineState *engine, MeterRecord *out, int max);
+
+// Renders `frames` stereo frames. Left samples go to out_l[i * stride] and
+// right samples to out_r[i * stride], so the same call serves interleaved
+// (out_r = out_l + 1, stride 2) and planar (stride 1) buffers.
+void engine_render(EngineState *engine, float *out_l, float *out_r, int stride, int frames);
+
+// Stems split the mix by the track that started each note: one stereo stem
+// per play/playseq track in program order, then one for drones. Voices are
+// allocated and stolen across tracks exactly as for the mix, and stems get
+// its master gain and bit depth. At 32 bits they sum to the mix up to float
+// rounding. At 16 or 24 bits each stem is quantized on its own, so the sum
+// can be off from the quantized mix by up to one step of that depth per stem.
+int engine_stem_count(const EngineState *engine);
+
+// Allocates the stem buffers. Call it once before engine_render_stems, off
+// the audio thread. Returns 0 when out of memory.
+int engine_enable_stems(EngineState *engine, char *error, size_t error_len);
+
+// engine_render into interleaved stereo `out`, also writing the stems to
+// `stems`, interleaved with 2 * engine_stem_count channels: the left and
+// right of stem 0, then of stem 1, and so on. The mix is the same as
+// engine_render's. Meant for offline renders, where the program doesn't
+// change, so the stem count stays put.
+void engine_render_stems(EngineState *engine, float *out, float *stems, int frames);
+
+#endif
@@ -4,6 +4,7 @@
 #import <CoreAudio/AudioHardware.h>
 
 #include "audio_engine.h"
+#include "render_cli.h"
 #import "meter_view.h"
 #import "memory_map_view.h"
 
@@ -100,37 +101,6 @@
     audio_engine_init();
     _errorRange = NSMakeRange(NSNotFound, 0);
 
-    NSArray<NSString *> *args = [[NSProcessInfo processInfo] arguments];
-    if (args.count >= 5 && [args[1] isEqualToString:@"--render"]) {
-        NSString *scriptPath = args[2];
-        NSString *outPath = args[3];
-        double seconds = [args[4] doubleValue];
-        int sampleRate = 48000;
-        int bufferFrames = 256;
-        if (args.count >= 6) {
-            sampleRate = [args[5] intValue];
-        }
-        if (args.count >= 7) {
-            bufferFrames = [args[6] intValue];
-        }
-        NSError *readErr = nil;
-        NSString *script = [NSString stringWithContentsOfFile:scriptPath encoding:NSUTF8StringEncoding error:&readErr];
-        if (!script) {
-            fprintf(stderr, "Failed to read script: %s\n", readErr.localizedDescription.UTF8String);
-            [NSApp terminate:nil];
-            return;
-        }
-        char error[256] = {0};
-        int ok = audio_engine_render_to_wav(script.UTF8String, outPath.UTF8String, seconds, sampleRate, bufferFrames, error, sizeof(error));
-        if (!ok) {
-            fprintf(stderr, "Render error: %s\n", error);
-        } else {
-            fprintf(stderr, "Rendered to %s\n", outPath.UTF8String);
-        }
-        [NSApp terminate:nil];
-        return;
-    }
-
     NSRect frame = NSMakeRect(0, 0, 1100, 700);
     _window = [[NSWindow alloc] initWithContentRect:frame
                                           styleMask:(NSWindowStyleMaskTitled | NSWindowStyleMaskClosable | NSWindowStyleMaskResizable)
@@ -944,6 +914,11 @@
 @end
 
 int main(int argc, const char *argv[]) {
+    // Headless renders never touch Cocoa or the audio device.
+    int cli_status = render_cli_main(argc, argv);
+    if (cli_status >= 0) {
+        return cli_status;
+    }
     @autoreleasepool {
         NSApplication *app = [NSApplication sharedApplication];
         [app setActivationPolicy:NSApplicationActivationPolicyRegular];
@@ -0,0 +1,73 @@
+#include "meter_ring.h"
+#include "dsp_simd.h"
+
+#include <math.h>
+
+_Static_assert((METER_RING_SIZE & (METER_RING_SIZE - 1)) == 0, "ring size must be a power of two");
+
+void meter_ring_init(MeterRing *ring) {
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->dropped, 0);
+}
+
+bool meter_ring_push(MeterRing *ring, const MeterRecord *rec) {
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail == METER_RING_SIZE) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return false;
+    }
+    ring->slots[head & (METER_RING_SIZE - 1)] = *rec;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+int meter_ring_read(MeterRing *ring, MeterRecord *out, int max) {
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    int n = 0;
+    while (n < max && tail != head) {
+        out[n++] = ring->slots[tail & (METER_RING_SIZE - 1)];
+        tail++;
+    }
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    return n;
+}
+
+unsigned long long meter_ring_dropped(const MeterRing *ring) {
+    return atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+}
+
+void meter_accumulate(MeterAccum *acc, const float *l, const float *r, int frames) {
+    dsp_f4 sum_l = dsp_f4_set1(0.0f);
+    dsp_f4 sum_r = dsp_f4_set1(0.0f);
+    dsp_f4 peak_l = dsp_f4_set1(0.0f);
+    dsp_f4 peak_r = dsp_f4_set1(0.0f);
+    int i = 0;
+    for (; i + DSP_F4_LANES <= frames; i += DSP_F4_LANES) {
+        dsp_f4 a = dsp_f4_load(l + i);
+        dsp_f4 b = dsp_f4_load(r + i);
+        sum_l = dsp_f4_add(sum_l, dsp_f4_mul(a, a));
+        sum_r = dsp_f4_add(sum_r, dsp_f4_mul(b, b));
+        peak_l = dsp_f4_max(peak_l, dsp_f4_abs(a));
+        peak_r = dsp_f4_max(peak_r, dsp_f4_abs(b));
+    }
+    _Alignas(16) float lanes[4][DSP_F4_LANES];
+    dsp_f4_store(lanes[0], sum_l);
+    dsp_f4_store(lanes[1], sum_r);
+    dsp_f4_store(lanes[2], peak_l);
+    dsp_f4_store(lanes[3], peak_r);
+    for (int k = 0; k < DSP_F4_LANES; k++) {
+        acc->sum_l += lanes[0][k];
+        acc->sum_r += lanes[1][k];
+        acc->peak_l = fmaxf(acc->peak_l, lanes[2][k]);
+        acc->peak_r = fmaxf(acc->peak_r, lanes[3][k]);
+    }
+    for (; i < frames; i++) {
+        acc->sum_l += l[i] * l[i];
+        acc->sum_r += r[i] * r[i];
+        acc->peak_l = fmaxf(acc->peak_l, fabsf(l[i]));
+        acc->peak_r = fmaxf(acc->peak_r, fabsf(r[i]));
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef METER_RING_H
+#define METER_RING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Per-block output meters, handed from the audio thread to one reader. The
+// audio thread appends a record for every rendered block; a reader that falls
+// more than METER_RING_SIZE blocks behind loses the newest records, which are
+// counted in `dropped`. Neither side locks or allocates.
+
+#define METER_RING_SIZE 4096 // records, a power of two: ~20 s of 256-frame blocks at 48 kHz
+
+typedef struct {
+    unsigned long long frame; // first frame of the block, counted from engine_init
+    int frames;
+    float rms_l;
+    float rms_r;
+    float peak_l;
+    float peak_r;
+    int clip; // some sample went past full scale
+} MeterRecord;
+
+typedef struct {
+    MeterRecord slots[METER_RING_SIZE];
+    _Alignas(64) atomic_uint head; // written by the audio thread
+    _Alignas(64) atomic_uint tail; // written by the reader
+    atomic_ullong dropped;
+} MeterRing;
+
+// Running sums over the chunks of one block.
+typedef struct {
+    float sum_l;
+    float sum_r;
+    float peak_l;
+    float peak_r;
+} MeterAccum;
+
+void meter_ring_init(MeterRing *ring);
+
+// Audio thread. Returns false, and counts the record as dropped, when full.
+bool meter_ring_push(MeterRing *ring, const MeterRecord *rec);
+
+// Reader. Copies up to `max` records, oldest first, and returns how many.
+int meter_ring_read(MeterRing *ring, MeterRecord *out, int max);
+
+// Records the reader has lost so far.
+unsigned long long meter_ring_dropped(const MeterRing *ring);
+
+// Adds `frames` contiguous samples per channel to the block's sums and peaks.
+// `l` and `r` must be 16-byte aligned.
+void meter_accumulate(MeterAccum *acc, const float *l, const float *r, int frames);
+
+#endif
@@ -0,0 +1,400 @@
+#include "render_cache.h"
+#include "engine_core.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define RENDER_CACHE_PATH 1024
+#define RENDER_CACHE_SUFFIX ".wav"
+#define RENDER_CACHE_NAME_LEN (64 + 4) // hex key + suffix
+
+struct RenderCache {
+    char dir[RENDER_CACHE_PATH];
+    unsigned long long max_bytes;
+    atomic_uint next_temp; // makes temporary names unique within the process
+};
+
+// SHA-256 (FIPS 180-4).
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;
+    unsigned char block[64];
+    size_t used;
+} Sha256;
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static uint32_t rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static void sha256_init(Sha256 *h) {
+    static const uint32_t initial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    memcpy(h->state, initial, sizeof(initial));
+    h->length = 0;
+    h->used = 0;
+}
+
+static void sha256_block(Sha256 *h, const unsigned char *p) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 | (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = h->state[0], b = h->state[1], c = h->state[2], d = h->state[3];
+    uint32_t e = h->state[4], f = h->state[5], g = h->state[6], k = h->state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = k + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        k = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    h->state[0] += a;
+    h->state[1] += b;
+    h->state[2] += c;
+    h->state[3] += d;
+    h->state[4] += e;
+    h->state[5] += f;
+    h->state[6] += g;
+    h->state[7] += k;
+}
+
+static void sha256_update(Sha256 *h, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    h->length += len;
+    while (len > 0) {
+        size_t n = 64 - h->used < len ? 64 - h->used : len;
+        memcpy(h->block + h->used, p, n);
+        h->used += n;
+        p += n;
+        len -= n;
+        if (h->used == 64) {
+            sha256_block(h, h->block);
+            h->used = 0;
+        }
+    }
+}
+
+static void sha256_final(Sha256 *h, unsigned char out[32]) {
+    uint64_t bits = h->length * 8;
+    unsigned char pad = 0x80;
+    sha256_update(h, &pad, 1);
+    pad = 0;
+    while (h->used != 56) {
+        sha256_update(h, &pad, 1);
+    }
+    unsigned char len[8];
+    for (int i = 0; i < 8; i++) {
+        len[i] = (unsigned char)(bits >> (56 - 8 * i));
+    }
+    sha256_update(h, len, 8);
+    for (int i = 0; i < 8; i++) {
+        out[4 * i] = (unsigned char)(h->state[i] >> 24);
+        out[4 * i + 1] = (unsigned char)(h->state[i] >> 16);
+        out[4 * i + 2] = (unsigned char)(h->state[i] >> 8);
+        out[4 * i + 3] = (unsigned char)h->state[i];
+    }
+}
+
+static void hash_u32(Sha256 *h, uint32_t v) {
+    unsigned char b[4] = {(unsigned char)v, (unsigned char)(v >> 8), (unsigned char)(v >> 16), (unsigned char)(v >> 24)};
+    sha256_update(h, b, 4);
+}
+
+// Normalization: the parser leaves a program's unused slots zeroed, but a
+// redefinition can leave stale bytes behind a shorter name or pattern. Clear
+// everything the engine never reads so only meaningful bytes are hashed.
+
+static void clear_name(char *name, size_t size) {
+    size_t len = 0;
+    while (len < size && name[len] != '\0') {
+        len++;
+    }
+    memset(name + len, 0, size - len);
+}
+
+static int clamp_count(int count, int max) {
+    return count < 0 ? 0 : (count > max ? max : count);
+}
+
+static void normalize_program(Program *p) {
+    int seq_len = clamp_count(p->time_sig_seq_len, 1024);
+    memset(p->time_sig_seq_num + seq_len, 0, sizeof(int) * (size_t)(1024 - seq_len));
+    memset(p->time_sig_seq_den + seq_len, 0, sizeof(int) * (size_t)(1024 - seq_len));
+
+    int synths = clamp_count(p->synth_count, DSL_MAX_SYNTHS);
+    for (int i = 0; i < synths; i++) {
+        SynthDef *synth = &p->synths[i];
+        clear_name(synth->name, sizeof(synth->name));
+        int mods = clamp_count(synth->mod_count, 32);
+        memset(synth->mods + mods, 0, sizeof(ModDef) * (size_t)(32 - mods));
+    }
+    memset(p->synths + synths, 0, sizeof(SynthDef) * (size_t)(DSL_MAX_SYNTHS - synths));
+
+    int patterns = clamp_count(p->pattern_count, DSL_MAX_PATTERNS);
+    for (int i = 0; i < patterns; i++) {
+        PatternDef *pattern = &p->patterns[i];
+        clear_name(pattern->name, sizeof(pattern->name));
+        int len = clamp_count(pattern->length, DSL_MAX_PATTERN);
+        size_t tail = (size_t)(DSL_MAX_PATTERN - len);
+        memset(pattern->notes + len, 0, sizeof(int) * tail);
+        memset(pattern->cents + len, 0, sizeof(float) * tail);
+        memset(pattern->degree + len, 0, sizeof(int) * tail);
+        memset(pattern->degree_octave + len, 0, sizeof(int) * tail);
+        memset(pattern->degree_micro + len, 0, sizeof(int) * tail);
+        memset(pattern->degree_valid + len, 0, sizeof(int) * tail);
+        memset(pattern->slide_ms + len, 0, sizeof(float) * tail);
+        memset(pattern->accent + len, 0, sizeof(int) * tail);
+    }
+    memset(p->patterns + patterns, 0, sizeof(PatternDef) * (size_t)(DSL_MAX_PATTERNS - patterns));
+
+    int sequences = clamp_count(p->sequence_count, DSL_MAX_SEQUENCES);
+    for (int i = 0; i < sequences; i++) {
+        SequenceDef *seq = &p->sequences[i];
+        clear_name(seq->name, sizeof(seq->name));
+        int steps = clamp_count(seq->count, DSL_MAX_SEQUENCE_STEPS);
+        for (int j = 0; j < steps; j++) {
+            clear_name(seq->steps[j].pattern, sizeof(seq->steps[j].pattern));
+        }
+        memset(seq->steps + steps, 0, sizeof(SequenceStep) * (size_t)(DSL_MAX_SEQUENCE_STEPS - steps));
+    }
+    memset(p->sequences + sequences, 0, sizeof(SequenceDef) * (size_t)(DSL_MAX_SEQUENCES - sequences));
+
+    int drones = clamp_count(p->drone_count, DSL_MAX_DRONES);
+    for (int i = 0; i < drones; i++) {
+        clear_name(p->drones[i].synth, sizeof(p->drones[i].synth));
+    }
+    memset(p->drones + drones, 0, sizeof(DroneDef) * (size_t)(DSL_MAX_DRONES - drones));
+
+    int tracks = clamp_count(p->track_count, DSL_MAX_TRACKS);
+    for (int i = 0; i < tracks; i++) {
+        clear_name(p->tracks[i].pattern, sizeof(p->tracks[i].pattern));
+        clear_name(p->tracks[i].synth, sizeof(p->tracks[i].synth));
+    }
+    memset(p->tracks + tracks, 0, sizeof(TrackDef) * (size_t)(DSL_MAX_TRACKS - tracks));
+}
+
+int render_cache_key(const Program *program, const RenderCacheParams *params, RenderCacheKey *key) {
+    Program *copy = (Program *)malloc(sizeof(Program));
+    if (!copy) {
+        return 0;
+    }
+    memcpy(copy, program, sizeof(Program));
+    normalize_program(copy);
+
+    Sha256 h;
+    sha256_init(&h);
+    hash_u32(&h, ENGINE_RENDER_VERSION);
+    uint64_t seconds;
+    memcpy(&seconds, &params->seconds, sizeof(seconds));
+    hash_u32(&h, (uint32_t)seconds);
+    hash_u32(&h, (uint32_t)(seconds >> 32));
+    hash_u32(&h, (uint32_t)params->sample_rate);
+    hash_u32(&h, (uint32_t)params->buffer_frames);
+    hash_u32(&h, (uint32_t)params->bit_depth);
+    hash_u32(&h, (uint32_t)params->file_format);
+    hash_u32(&h, (uint32_t)params->until_silence);
+    sha256_update(&h, copy, sizeof(Program));
+    sha256_final(&h, key->bytes);
+    free(copy);
+    return 1;
+}
+
+RenderCache *render_cache_open(const char *dir, unsigned long long max_bytes, char *error, size_t error_len) {
+    if (!dir || strlen(dir) + 1 + RENDER_CACHE_NAME_LEN + 32 >= RENDER_CACHE_PATH) {
+        snprintf(error, error_len, "Invalid cache directory");
+        return NULL;
+    }
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+        snprintf(error, error_len, "Cannot create %s: %s", dir, strerror(errno));
+        return NULL;
+    }
+    RenderCache *cache = (RenderCache *)calloc(1, sizeof(RenderCache));
+    if (!cache) {
+        snprintf(error, error_len, "Out of memory");
+        return NULL;
+    }
+    snprintf(cache->dir, sizeof(cache->dir), "%s", dir);
+    cache->max_bytes = max_bytes;
+    atomic_init(&cache->next_temp, 0);
+    return cache;
+}
+
+void render_cache_close(RenderCache *cache) {
+    free(cache);
+}
+
+// Returns 0 if the path doesn't fit in `len`.
+static int entry_path(const RenderCache *cache, const RenderCacheKey *key, char *path, size_t len) {
+    char hex[65];
+    for (int i = 0; i < 32; i++) {
+        snprintf(hex + 2 * i, 3, "%02x", key->bytes[i]);
+    }
+    int n = snprintf(path, len, "%s/%s%s", cache->dir, hex, RENDER_CACHE_SUFFIX);
+    return n >= 0 && (size_t)n < len;
+}
+
+static int copy_file(const char *from, const char *to) {
+    FILE *in = fopen(from, "rb");
+    if (!in) {
+        return 0;
+    }
+    FILE *out = fopen(to, "wb");
+    if (!out) {
+        fclose(in);
+        return 0;
+    }
+    enum { CHUNK = 1 << 16 };
+    unsigned char *buffer = (unsigned char *)malloc(CHUNK);
+    int ok = buffer != NULL;
+    size_t n;
+    while (ok && (n = fread(buffer, 1, CHUNK, in)) > 0) {
+        ok = fwrite(buffer, 1, n, out) == n;
+    }
+    ok = ok && !ferror(in);
+    free(buffer);
+    fclose(in);
+    if (fclose(out) != 0) {
+        ok = 0;
+    }
+    return ok;
+}
+
+int render_cache_fetch(RenderCache *cache, const RenderCacheKey *key, const char *path) {
+    char entry[RENDER_CACHE_PATH];
+    struct stat st;
+    if (!entry_path(cache, key, entry, sizeof(entry)) || stat(entry, &st) != 0) {
+        return 0;
+    }
+    // Only a regular file (or nothing) at `path` is replaced by a link; a
+    // device or symlink is written through.
+    int linked = 0;
+    if (lstat(path, &st) != 0 || S_ISREG(st.st_mode)) {
+        unlink(path);
+        linked = link(entry, path) == 0;
+    }
+    if (!linked && !copy_file(entry, path)) {
+        return 0;
+    }
+    // Marks the entry recently used.
+    utimes(entry, NULL);
+    return 1;
+}
+
+typedef struct {
+    char name[RENDER_CACHE_NAME_LEN + 1];
+    unsigned long long bytes;
+    time_t used;
+} CacheEntry;
+
+static int compare_entries(const void *a, const void *b) {
+    const CacheEntry *x = (const CacheEntry *)a;
+    const CacheEntry *y = (const CacheEntry *)b;
+    if (x->used != y->used) {
+        return x->used < y->used ? -1 : 1;
+    }
+    return strcmp(x->name, y->name);
+}
+
+// Removes least recently used entries until the rest fit in max_bytes.
+static void trim(RenderCache *cache) {
+    DIR *dir = opendir(cache->dir);
+    if (!dir) {
+        return;
+    }
+    CacheEntry *entries = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    unsigned long long total = 0;
+    char path[RENDER_CACHE_PATH];
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        size_t len = strlen(ent->d_name);
+        if (len != RENDER_CACHE_NAME_LEN || strcmp(ent->d_name + 64, RENDER_CACHE_SUFFIX) != 0) {
+            continue;
+        }
+        int n = snprintf(path, sizeof(path), "%s/%s", cache->dir, ent->d_name);
+        struct stat st;
+        if (n < 0 || (size_t)n >= sizeof(path) || stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        if (count == capacity) {
+            size_t grown = capacity ? capacity * 2 : 64;
+            CacheEntry *more = (CacheEntry *)realloc(entries, grown * sizeof(CacheEntry));
+            if (!more) {
+                break;
+            }
+            entries = more;
+            capacity = grown;
+        }
+        memcpy(entries[count].name, ent->d_name, len + 1);
+        entries[count].bytes = (unsigned long long)st.st_size;
+        entries[count].used = st.st_mtime;
+        total += entries[count].bytes;
+        count++;
+    }
+    closedir(dir);
+
+    if (total > cache->max_bytes) {
+        qsort(entries, count, sizeof(CacheEntry), compare_entries);
+        for (size_t i = 0; i < count && total > cache->max_bytes; i++) {
+            int n = snprintf(path, sizeof(path), "%s/%s", cache->dir, entries[i].name);
+            if (n >= 0 && (size_t)n < sizeof(path) && unlink(path) == 0) {
+                total -= entries[i].bytes;
+            }
+        }
+    }
+    free(entries);
+}
+
+void render_cache_store(RenderCache *cache, const RenderCacheKey *key, const char *path) {
+    char entry[RENDER_CACHE_PATH];
+    char temp[RENDER_CACHE_PATH];
+    if (!entry_path(cache, key, entry, sizeof(entry))) {
+        return;
+    }
+    unsigned n = atomic_fetch_add_explicit(&cache->next_temp, 1, memory_order_relaxed);
+    int written = snprintf(temp, sizeof(temp), "%s.%ld-%u.tmp", entry, (long)getpid(), n);
+    if (written < 0 || (size_t)written >= sizeof(temp)) {
+        return;
+    }
+    // The entry appears under its name complete or not at all.
+    if (link(path, temp) != 0 && !copy_file(path, temp)) {
+        unlink(temp);
+        return;
+    }
+    int stored = rename(temp, entry) == 0;
+    // Still there if the rename failed or `path` already was the entry.
+    unlink(temp);
+    if (stored) {
+        trim(cache);
+    }
+}
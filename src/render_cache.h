@@ -0,0 +1,50 @@
+#ifndef RENDER_CACHE_H
+#define RENDER_CACHE_H
+
+#include "dsl.h"
+
+#include <stddef.h>
+
+// A directory of finished renders named by a hash of everything that decides
+// their samples: the parsed program (so edits to comments and whitespace
+// don't matter), the render settings and ENGINE_RENDER_VERSION. Entries are
+// only ever added by rename and removed by unlink, so several threads and
+// processes can share one directory.
+//
+// Entries are hard links where the filesystem allows, else copies. A file
+// linked from the cache must not be rewritten in place; wav_writer_open
+// replaces such files instead.
+
+typedef struct RenderCache RenderCache;
+
+// Everything besides the program that changes a render's file.
+typedef struct {
+    double seconds;
+    int sample_rate;
+    int buffer_frames;
+    int bit_depth;
+    int file_format; // WavFormat
+    int until_silence;
+} RenderCacheParams;
+
+typedef struct {
+    unsigned char bytes[32]; // SHA-256
+} RenderCacheKey;
+
+// Opens `dir`, creating it if missing. Once the entries pass max_bytes the
+// least recently used are removed.
+RenderCache *render_cache_open(const char *dir, unsigned long long max_bytes, char *error, size_t error_len);
+void render_cache_close(RenderCache *cache);
+
+// Returns 0 if out of memory.
+int render_cache_key(const Program *program, const RenderCacheParams *params, RenderCacheKey *key);
+
+// Puts the entry for `key` at `path`. Returns 0 if there is none or it can't
+// be placed there.
+int render_cache_fetch(RenderCache *cache, const RenderCacheKey *key, const char *path);
+
+// Adds the finished file at `path` as the entry for `key`, then trims the
+// cache to its size. Failures only mean the next render misses.
+void render_cache_store(RenderCache *cache, const RenderCacheKey *key, const char *path);
+
+#endif
@@ -0,0 +1,347 @@
+#include "render_cli.h"
+#include "audio_engine.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RENDER_CLI_CACHE_MB 4096ull // default --cache-max
+
+static char *read_text_file(const char *path, char *error, size_t error_len) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        snprintf(error, error_len, "%s", strerror(errno));
+        return NULL;
+    }
+    long size = -1;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        size = ftell(file);
+        rewind(file);
+    }
+    if (size < 0) {
+        fclose(file);
+        snprintf(error, error_len, "Cannot determine file size");
+        return NULL;
+    }
+    char *text = (char *)malloc((size_t)size + 1);
+    if (!text) {
+        fclose(file);
+        snprintf(error, error_len, "Out of memory");
+        return NULL;
+    }
+    size_t len = fread(text, 1, (size_t)size, file);
+    fclose(file);
+    text[len] = '\0';
+    return text;
+}
+
+// Parses a --format name into audio_engine_set_file_format arguments.
+static int parse_format(const char *name, int *bits, int *is_float) {
+    static const struct {
+        const char *name;
+        int bits;
+        int is_float;
+    } formats[] = {{"f32", 32, 1}, {"s16", 16, 0}, {"s24", 24, 0}, {"s32", 32, 0}};
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        if (strcmp(name, formats[i].name) == 0) {
+            *bits = formats[i].bits;
+            *is_float = formats[i].is_float;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Flags that --render and --render-batch share.
+typedef struct {
+    int format_bits;
+    int format_float;
+    const char *cache_dir;
+    unsigned long long cache_mb;
+} OutputOptions;
+
+static void init_output_options(OutputOptions *options) {
+    options->format_bits = 32;
+    options->format_float = 1;
+    options->cache_dir = NULL;
+    options->cache_mb = RENDER_CLI_CACHE_MB;
+}
+
+// Returns 1 if argv[*i] was one of the shared flags, stepping *i past its
+// value, 0 if it wasn't, and -1 if its value is missing or bad.
+static int parse_output_option(int argc, const char *argv[], int *i, OutputOptions *options) {
+    const char *flag = argv[*i];
+    if (strcmp(flag, "--format") != 0 && strcmp(flag, "--cache") != 0 && strcmp(flag, "--cache-max") != 0) {
+        return 0;
+    }
+    if (*i + 1 >= argc) {
+        return -1;
+    }
+    const char *value = argv[++*i];
+    if (strcmp(flag, "--format") == 0) {
+        return parse_format(value, &options->format_bits, &options->format_float) ? 1 : -1;
+    }
+    if (strcmp(flag, "--cache") == 0) {
+        options->cache_dir = value;
+        return 1;
+    }
+    options->cache_mb = strtoull(value, NULL, 10);
+    return 1;
+}
+
+static int apply_output_options(const OutputOptions *options) {
+    audio_engine_set_file_format(options->format_bits, options->format_float);
+    char error[256] = {0};
+    if (options->cache_dir &&
+        !audio_engine_set_render_cache(options->cache_dir, options->cache_mb * 1024 * 1024, error, sizeof(error))) {
+        fprintf(stderr, "Render cache: %s\n", error);
+        return 0;
+    }
+    return 1;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Splits `line` in place at spaces and tabs. Returns the field count, or
+// max + 1 if there are more than `max`.
+static int split_fields(char *line, char **fields, int max) {
+    int count = 0;
+    char *p = line;
+    for (;;) {
+        while (*p == ' ' || *p == '\t' || *p == '\r') {
+            p++;
+        }
+        if (*p == '\0') {
+            return count;
+        }
+        if (count == max) {
+            return max + 1;
+        }
+        fields[count++] = p;
+        while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\r') {
+            p++;
+        }
+        if (*p != '\0') {
+            *p++ = '\0';
+        }
+    }
+}
+
+// --render-batch <manifest> [threads] [output options]
+static int render_batch_main(int argc, const char *argv[]) {
+    const char *manifest_path = argv[2];
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = cores > 0 ? (int)cores : 1;
+    OutputOptions options;
+    init_output_options(&options);
+    int have_threads = 0;
+    for (int i = 3; i < argc; i++) {
+        int parsed = parse_output_option(argc, argv, &i, &options);
+        if (parsed < 0) {
+            return -1;
+        }
+        if (parsed == 0) {
+            // The only positional argument is the thread count.
+            char *end = NULL;
+            long value = strtol(argv[i], &end, 10);
+            if (have_threads || end == argv[i] || *end != '\0' || value < 1 || value > INT_MAX) {
+                return -1;
+            }
+            threads = (int)value;
+            have_threads = 1;
+        }
+    }
+
+    char error[256] = {0};
+    char *manifest = read_text_file(manifest_path, error, sizeof(error));
+    if (!manifest) {
+        fprintf(stderr, "Failed to read manifest: %s\n", error);
+        return 1;
+    }
+    int lines = 1;
+    for (const char *p = manifest; *p; p++) {
+        lines += *p == '\n';
+    }
+    AudioRenderJob *jobs = (AudioRenderJob *)calloc((size_t)lines, sizeof(AudioRenderJob));
+    if (!jobs) {
+        free(manifest);
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    // Scripts that can't be read fail here; the rest become jobs.
+    int job_count = 0;
+    int unreadable = 0;
+    int status = 0;
+    char *line = manifest;
+    for (int line_no = 1; line && status == 0; line_no++) {
+        char *next = strchr(line, '\n');
+        if (next) {
+            *next++ = '\0';
+        }
+        char *hash = strchr(line, '#');
+        if (hash) {
+            *hash = '\0';
+        }
+        char *fields[4];
+        int n = split_fields(line, fields, 4);
+        line = next;
+        if (n == 0) {
+            continue;
+        }
+        if (n < 3 || n > 4 || !(atof(fields[2]) > 0.0)) {
+            fprintf(stderr, "%s:%d: expected <script> <output.wav> <seconds> [sample_rate]\n", manifest_path, line_no);
+            status = 1;
+            break;
+        }
+        char *script = read_text_file(fields[0], error, sizeof(error));
+        if (!script) {
+            printf("FAIL  %s: %s\n", fields[0], error);
+            unreadable++;
+            continue;
+        }
+        AudioRenderJob *job = &jobs[job_count++];
+        job->script = script;
+        job->output_path = fields[1];
+        job->seconds = atof(fields[2]);
+        job->sample_rate = n > 3 ? atoi(fields[3]) : 48000;
+        job->buffer_frames = 256;
+    }
+
+    audio_engine_init();
+    if (status == 0 && !apply_output_options(&options)) {
+        status = 1;
+    }
+    if (status == 0) {
+        double start = now_seconds();
+        int failed = unreadable + audio_engine_render_batch(jobs, job_count, threads);
+        double wall = now_seconds() - start;
+        double audio = 0.0;
+        for (int i = 0; i < job_count; i++) {
+            const AudioRenderJob *job = &jobs[i];
+            if (job->cached) {
+                printf("ok      cached  %s\n", job->output_path);
+                audio += job->seconds;
+            } else if (job->ok) {
+                printf("ok    %8.1fx  %s\n", job->seconds / job->elapsed, job->output_path);
+                audio += job->seconds;
+            } else {
+                printf("FAIL  %s: %s\n", job->output_path, job->error);
+            }
+        }
+        int total = job_count + unreadable;
+        printf("%d of %d jobs rendered: %.1f s of audio in %.1f s, %.1fx realtime\n", total - failed, total, audio, wall,
+               wall > 0.0 ? audio / wall : 0.0);
+        status = failed ? 1 : 0;
+    }
+
+    for (int i = 0; i < job_count; i++) {
+        free((char *)jobs[i].script);
+    }
+    free(jobs);
+    free(manifest);
+    return status;
+}
+
+int render_cli_main(int argc, const char *argv[]) {
+    if (argc >= 3 && strcmp(argv[1], "--render-batch") == 0) {
+        return render_batch_main(argc, argv);
+    }
+    if (argc < 5 || strcmp(argv[1], "--render") != 0) {
+        return -1;
+    }
+    const char *script_path = argv[2];
+
+    // Flags may go anywhere after the script; the rest are positional.
+    const char *stems_path = NULL;
+    int multichannel = 0;
+    int raw = 0;
+    int until_silence = 0;
+    OutputOptions options;
+    init_output_options(&options);
+    const char *args[5] = {NULL};
+    int arg_count = 0;
+    int parsed;
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--stems") == 0 || strcmp(argv[i], "--stems-multichannel") == 0) {
+            if (i + 1 >= argc) {
+                return -1;
+            }
+            multichannel = strcmp(argv[i], "--stems-multichannel") == 0;
+            stems_path = argv[++i];
+        } else if (strcmp(argv[i], "--raw") == 0) {
+            raw = 1;
+        } else if (strcmp(argv[i], "--until-silence") == 0) {
+            until_silence = 1;
+        } else if ((parsed = parse_output_option(argc, argv, &i, &options)) != 0) {
+            if (parsed < 0) {
+                return -1;
+            }
+        } else if (arg_count < 5) {
+            args[arg_count++] = argv[i];
+        } else {
+            return -1;
+        }
+    }
+    // A stem render takes its output from the flag.
+    int first = stems_path ? 0 : 1;
+    if (arg_count < first + 1) {
+        return -1;
+    }
+    const char *out_path = stems_path ? stems_path : args[0];
+    double seconds = atof(args[first]);
+    int sample_rate = 48000;
+    int buffer_frames = 256;
+    int threads = 1;
+    if (arg_count > first + 1) {
+        sample_rate = atoi(args[first + 1]);
+    }
+    if (arg_count > first + 2) {
+        buffer_frames = atoi(args[first + 2]);
+    }
+    if (arg_count > first + 3) {
+        threads = atoi(args[first + 3]);
+    }
+
+    char error[256] = {0};
+    char *script = read_text_file(script_path, error, sizeof(error));
+    if (!script) {
+        fprintf(stderr, "Failed to read script: %s\n", error);
+        return 1;
+    }
+
+    audio_engine_init();
+    audio_engine_set_render_threads(threads);
+    if (!apply_output_options(&options)) {
+        free(script);
+        return 1;
+    }
+    int ok;
+    if (stems_path) {
+        ok = audio_engine_render_stems(script, out_path, seconds, sample_rate, buffer_frames, multichannel, error, sizeof(error));
+    } else {
+        ok = audio_engine_render_stream(script, out_path, seconds, until_silence, raw, sample_rate, buffer_frames, error, sizeof(error));
+    }
+    free(script);
+    if (!ok) {
+        fprintf(stderr, "Render error: %s\n", error);
+        return 1;
+    }
+    unsigned long long allocs = 0, steals = 0, drops = 0;
+    audio_engine_get_render_voice_stats(&allocs, &steals, &drops);
+    if (audio_engine_render_was_cached()) {
+        fprintf(stderr, "Reused cached render for %s\n", out_path);
+        return 0;
+    }
+    fprintf(stderr, "Rendered to %s\n", strcmp(out_path, "-") == 0 ? "stdout" : out_path);
+    fprintf(stderr, "Voices: %llu notes, %llu stolen, %llu dropped\n", allocs, steals, drops);
+    return 0;
+}
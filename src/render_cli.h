@@ -0,0 +1,29 @@
+#ifndef RENDER_CLI_H
+#define RENDER_CLI_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Headless command line shared by the app and the Linux render binary:
+//   --render <script.jamal> <output.wav> <seconds> [sample_rate] [buffer_frames] [threads]
+// Stem renders put --stems <dir> or --stems-multichannel <output.wav> in
+// place of the output path. An output path of "-" streams WAV to stdout, or
+// bare samples with --raw. --format f32|s16|s24|s32 picks the sample format
+// (default f32). `seconds` may be "inf", and --until-silence stops after 2
+// seconds of silence.
+//   --render-batch <manifest> [threads]
+// renders every `<script> <output.wav> <seconds> [sample_rate]` line of the
+// manifest (# starts a comment), `threads` jobs at a time (default: one per
+// core), and prints each job's speed and any failures.
+// Both take --cache <dir> to reuse earlier renders of the same program and
+// settings, keeping up to --cache-max MB (default 4096).
+// Returns -1 when argv is not a headless invocation, otherwise the process
+// exit status.
+int render_cli_main(int argc, const char *argv[]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
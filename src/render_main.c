@@ -0,0 +1,17 @@
+#include "render_cli.h"
+
+#include <stdio.h>
+
+// Entry point for the headless render binary (no UI, no audio device).
+int main(int argc, const char *argv[]) {
+    int status = render_cli_main(argc, argv);
+    if (status < 0) {
+        fprintf(stderr,
+                "usage: %s --render <script.jamal> <output.wav | --stems <dir> | --stems-multichannel <output.wav>> "
+                "<seconds|inf> [sample_rate] [buffer_frames] [threads] [--format f32|s16|s24|s32] [--raw] [--until-silence] [--cache <dir> [--cache-max <MB>]]\n"
+                "       %s --render-batch <manifest> [threads] [--format f32|s16|s24|s32] [--cache <dir> [--cache-max <MB>]]\n",
+                argv[0], argv[0]);
+        return 2;
+    }
+    return status;
+}
@@ -0,0 +1,265 @@
+#include "render_pool.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifdef __APPLE__
+#include <dispatch/dispatch.h>
+#else
+#include <semaphore.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#define RENDER_POOL_MAX_THREADS 64
+// A worker waits this many CPU pauses for the next batch before sleeping:
+// long enough to span the sequencer and mixing work between the batches of
+// one block, short enough not to hold a core between blocks.
+#define RENDER_POOL_SPINS 4000
+
+// The jobs one thread starts with. Other threads steal from the front too, so
+// `next` is the only shared word.
+typedef struct {
+    _Alignas(64) atomic_int next;
+    int end;
+} JobRange;
+
+typedef struct {
+    RenderPool *pool;
+    int index;
+    pthread_t thread;
+    atomic_bool sleeping;
+#ifdef __APPLE__
+    dispatch_semaphore_t wake;
+#else
+    sem_t wake;
+#endif
+} Worker;
+
+struct RenderPool {
+    int threads;
+    bool matched_priority;
+    Worker workers[RENDER_POOL_MAX_THREADS]; // [0] is the calling thread
+    JobRange ranges[RENDER_POOL_MAX_THREADS];
+
+    RenderJobFn fn;
+    void *ctx;
+
+    _Alignas(64) atomic_uint batch; // bumped to publish a batch
+    _Alignas(64) atomic_int busy;   // workers still in the current batch
+    atomic_bool quit;
+};
+
+static void cpu_pause(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static void sem_wake(Worker *w) {
+#ifdef __APPLE__
+    dispatch_semaphore_signal(w->wake);
+#else
+    sem_post(&w->wake);
+#endif
+}
+
+static void sem_sleep(Worker *w) {
+#ifdef __APPLE__
+    dispatch_semaphore_wait(w->wake, DISPATCH_TIME_FOREVER);
+#else
+    while (sem_wait(&w->wake) != 0) {
+    }
+#endif
+}
+
+// Runs jobs from this thread's range, then from everyone else's.
+static void work(RenderPool *pool, int self) {
+    for (int k = 0; k < pool->threads; k++) {
+        JobRange *range = &pool->ranges[(self + k) % pool->threads];
+        for (;;) {
+            int job = atomic_fetch_add_explicit(&range->next, 1, memory_order_relaxed);
+            if (job >= range->end) {
+                break;
+            }
+            pool->fn(pool->ctx, job);
+        }
+    }
+}
+
+// Waits until the batch counter moves past `seen` or the pool shuts down.
+// A worker announces it is about to sleep, then checks once more; whoever
+// clears the flag (the worker on seeing a batch, or render_pool_run) decides
+// whether a wake-up is owed.
+static unsigned wait_for_batch(Worker *w, unsigned seen) {
+    RenderPool *pool = w->pool;
+    for (int spins = 0; spins < RENDER_POOL_SPINS; spins++) {
+        unsigned batch = atomic_load_explicit(&pool->batch, memory_order_acquire);
+        if (batch != seen || atomic_load_explicit(&pool->quit, memory_order_acquire)) {
+            return batch;
+        }
+        cpu_pause();
+    }
+    for (;;) {
+        atomic_store_explicit(&w->sleeping, true, memory_order_seq_cst);
+        unsigned batch = atomic_load_explicit(&pool->batch, memory_order_seq_cst);
+        if (batch != seen || atomic_load_explicit(&pool->quit, memory_order_seq_cst)) {
+            if (!atomic_exchange_explicit(&w->sleeping, false, memory_order_seq_cst)) {
+                sem_sleep(w); // the post is already on its way
+            }
+            return atomic_load_explicit(&pool->batch, memory_order_acquire);
+        }
+        sem_sleep(w);
+    }
+}
+
+static void *worker_main(void *arg) {
+    Worker *w = (Worker *)arg;
+    RenderPool *pool = w->pool;
+    unsigned seen = 0;
+    for (;;) {
+        unsigned batch = wait_for_batch(w, seen);
+        if (atomic_load_explicit(&pool->quit, memory_order_acquire)) {
+            return NULL;
+        }
+        if (batch == seen) {
+            continue;
+        }
+        seen = batch;
+        work(pool, w->index);
+        atomic_fetch_sub_explicit(&pool->busy, 1, memory_order_release);
+    }
+}
+
+static void wake_sleepers(RenderPool *pool) {
+    for (int i = 1; i < pool->threads; i++) {
+        Worker *w = &pool->workers[i];
+        if (atomic_load_explicit(&w->sleeping, memory_order_seq_cst) &&
+            atomic_exchange_explicit(&w->sleeping, false, memory_order_seq_cst)) {
+            sem_wake(w);
+        }
+    }
+}
+
+// Best effort: without the privilege for a real-time policy the workers keep
+// the default one.
+static void match_priority(RenderPool *pool) {
+    int policy;
+    struct sched_param param;
+    if (pthread_getschedparam(pthread_self(), &policy, &param) != 0) {
+        return;
+    }
+    for (int i = 1; i < pool->threads; i++) {
+        pthread_setschedparam(pool->workers[i].thread, policy, &param);
+    }
+}
+
+RenderPool *render_pool_create(int threads) {
+    if (threads < 2) {
+        return NULL;
+    }
+    if (threads > RENDER_POOL_MAX_THREADS) {
+        threads = RENDER_POOL_MAX_THREADS;
+    }
+    RenderPool *pool = (RenderPool *)aligned_alloc(_Alignof(RenderPool), sizeof(RenderPool));
+    if (!pool) {
+        return NULL;
+    }
+    pool->threads = 1;
+    pool->matched_priority = false;
+    pool->fn = NULL;
+    pool->ctx = NULL;
+    atomic_init(&pool->batch, 0);
+    atomic_init(&pool->busy, 0);
+    atomic_init(&pool->quit, false);
+    for (int i = 0; i < RENDER_POOL_MAX_THREADS; i++) {
+        atomic_init(&pool->ranges[i].next, 0);
+        pool->ranges[i].end = 0;
+    }
+    for (int i = 1; i < threads; i++) {
+        Worker *w = &pool->workers[i];
+        w->pool = pool;
+        w->index = i;
+        atomic_init(&w->sleeping, false);
+#ifdef __APPLE__
+        w->wake = dispatch_semaphore_create(0);
+        bool ok = w->wake != NULL;
+#else
+        bool ok = sem_init(&w->wake, 0, 0) == 0;
+#endif
+        if (ok && pthread_create(&w->thread, NULL, worker_main, w) != 0) {
+#ifdef __APPLE__
+            dispatch_release(w->wake);
+#else
+            sem_destroy(&w->wake);
+#endif
+            ok = false;
+        }
+        if (!ok) {
+            render_pool_destroy(pool);
+            return NULL;
+        }
+        pool->threads = i + 1;
+    }
+    return pool;
+}
+
+void render_pool_destroy(RenderPool *pool) {
+    if (!pool) {
+        return;
+    }
+    atomic_store_explicit(&pool->quit, true, memory_order_seq_cst);
+    wake_sleepers(pool);
+    for (int i = 1; i < pool->threads; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+#ifdef __APPLE__
+        dispatch_release(pool->workers[i].wake);
+#else
+        sem_destroy(&pool->workers[i].wake);
+#endif
+    }
+    free(pool);
+}
+
+int render_pool_threads(const RenderPool *pool) {
+    return pool ? pool->threads : 1;
+}
+
+void render_pool_run(RenderPool *pool, int jobs, RenderJobFn fn, void *ctx) {
+    if (!pool->matched_priority) {
+        match_priority(pool);
+        pool->matched_priority = true;
+    }
+    pool->fn = fn;
+    pool->ctx = ctx;
+    int threads = pool->threads;
+    for (int i = 0; i < threads; i++) {
+        atomic_store_explicit(&pool->ranges[i].next, jobs * i / threads, memory_order_relaxed);
+        pool->ranges[i].end = jobs * (i + 1) / threads;
+    }
+    atomic_store_explicit(&pool->busy, threads - 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&pool->batch, 1, memory_order_seq_cst);
+    wake_sleepers(pool);
+
+    work(pool, 0);
+
+    // Every worker has to leave the batch before its ranges can be reused.
+    // Once the calling thread runs out of jobs the rest are already running,
+    // so this wait is at most one job long.
+    int spins = 0;
+    while (atomic_load_explicit(&pool->busy, memory_order_acquire) > 0) {
+        if (++spins < 64) {
+            cpu_pause();
+        } else {
+            spins = 0;
+            sched_yield();
+        }
+    }
+}
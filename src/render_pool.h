@@ -0,0 +1,31 @@
+#ifndef RENDER_POOL_H
+#define RENDER_POOL_H
+
+// A persistent pool of render threads for splitting one block's voices
+// across cores. The thread calling render_pool_run works too, so a pool of
+// `threads` uses threads - 1 extra threads.
+//
+// A batch of jobs is split into one contiguous range per thread; a thread
+// that finishes its range takes jobs from the others' ranges. Which thread
+// runs which job varies from run to run, so jobs must write only their own
+// outputs. After a batch, workers spin briefly for the next one, so the
+// batches of one audio block cost no system calls, then sleep until woken.
+
+typedef struct RenderPool RenderPool;
+
+typedef void (*RenderJobFn)(void *ctx, int job);
+
+// Starts threads - 1 worker threads. Returns NULL if threads < 2 or a thread
+// fails to start.
+RenderPool *render_pool_create(int threads);
+void render_pool_destroy(RenderPool *pool);
+
+int render_pool_threads(const RenderPool *pool);
+
+// Runs fn(ctx, j) for every j in [0, jobs) across the pool and returns once
+// all have finished. Call it from one thread at a time. On the first call the
+// workers take on that thread's scheduling policy and priority, so a pool run
+// from a real-time audio callback renders at the callback's priority.
+void render_pool_run(RenderPool *pool, int jobs, RenderJobFn fn, void *ctx);
+
+#endif
@@ -0,0 +1,1632 @@
+#include "voice.h"
+#include "dsp_math.h"
+#include "dsp_simd.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Phase offsets and ratios below were tuned in radians; phases are now in
+// cycles (see dsp_phase_inc).
+#define RAD_TO_TURNS(x) ((x) * (float)(1.0 / (2.0 * M_PI)))
+
+// The pulse oscillator is high for the first 30% of each cycle.
+#define VOICE_PULSE_EDGE 0x4CCCCCCCu
+
+_Static_assert(sizeof(Voice) <= 192, "the hot voice record fits in three cache lines");
+
+typedef enum {
+    NOISE_NONE,
+    NOISE_LCG,
+    NOISE_GLITCH,
+    NOISE_EXCITE // LCG draw only during the 96-sample excitation burst
+} NoiseKind;
+
+typedef enum {
+    CHAIN_PLAIN,  // render_filters
+    CHAIN_PM,     // render_pm_filters
+    CHAIN_PM_DRUM // render_pm_filters, quantised to 7 bits
+} FilterChain;
+
+// Per-type render traits: the noise source, whether noise is high-passed
+// before the body filter, whether the voice runs a comb delay line, and the
+// filter chain. The trait lookups and the render kernels are generated from
+// this table; a new synth type needs a row here and its cases in the stages.
+#define VOICE_KERNELS(X)                                 \
+    X(SYNTH_SINE,      NOISE_NONE,   0, 0, CHAIN_PLAIN)   \
+    X(SYNTH_SAW,       NOISE_NONE,   0, 0, CHAIN_PLAIN)   \
+    X(SYNTH_SUPERSAW,  NOISE_NONE,   0, 0, CHAIN_PLAIN)   \
+    X(SYNTH_SQUARE,    NOISE_NONE,   0, 0, CHAIN_PLAIN)   \
+    X(SYNTH_TRI,       NOISE_NONE,   0, 0, CHAIN_PLAIN)   \
+    X(SYNTH_NOISE,     NOISE_LCG,    0, 0, CHAIN_PLAIN)   \
+    X(SYNTH_PULSE,     NOISE_NONE,   0, 0, CHAIN_PLAIN)   \
+    X(SYNTH_FM,        NOISE_NONE,   0, 0, CHAIN_PLAIN)   \
+    X(SYNTH_RING,      NOISE_NONE,   0, 0, CHAIN_PLAIN)   \
+    X(SYNTH_ACID,      NOISE_NONE,   0, 0, CHAIN_PLAIN)   \
+    X(SYNTH_KICK,      NOISE_NONE,   0, 0, CHAIN_PLAIN)   \
+    X(SYNTH_KICK808,   NOISE_NONE,   0, 0, CHAIN_PLAIN)   \
+    X(SYNTH_KICK909,   NOISE_NONE,   0, 0, CHAIN_PLAIN)   \
+    X(SYNTH_SNARE,     NOISE_LCG,    1, 0, CHAIN_PLAIN)   \
+    X(SYNTH_SNARE808,  NOISE_LCG,    1, 0, CHAIN_PLAIN)   \
+    X(SYNTH_SNARE909,  NOISE_LCG,    1, 0, CHAIN_PLAIN)   \
+    X(SYNTH_CLAP,      NOISE_LCG,    1, 0, CHAIN_PLAIN)   \
+    X(SYNTH_CLAP909,   NOISE_LCG,    1, 0, CHAIN_PLAIN)   \
+    X(SYNTH_HAT_C,     NOISE_LCG,    1, 0, CHAIN_PLAIN)   \
+    X(SYNTH_HAT_O,     NOISE_LCG,    1, 0, CHAIN_PLAIN)   \
+    X(SYNTH_HAT808,    NOISE_LCG,    1, 0, CHAIN_PLAIN)   \
+    X(SYNTH_HAT909,    NOISE_LCG,    1, 0, CHAIN_PLAIN)   \
+    X(SYNTH_TOM,       NOISE_NONE,   0, 0, CHAIN_PLAIN)   \
+    X(SYNTH_RIM,       NOISE_LCG,    1, 0, CHAIN_PLAIN)   \
+    X(SYNTH_GLITCH,    NOISE_GLITCH, 0, 0, CHAIN_PLAIN)   \
+    X(SYNTH_METAL,     NOISE_NONE,   0, 0, CHAIN_PLAIN)   \
+    X(SYNTH_BITPERC,   NOISE_LCG,    1, 0, CHAIN_PLAIN)   \
+    X(SYNTH_FM2,       NOISE_NONE,   0, 0, CHAIN_PLAIN)   \
+    X(SYNTH_COMB,      NOISE_EXCITE, 0, 1, CHAIN_PLAIN)   \
+    X(SYNTH_PM_STRING, NOISE_EXCITE, 0, 1, CHAIN_PM)      \
+    X(SYNTH_PM_BELL,   NOISE_NONE,   0, 1, CHAIN_PM)      \
+    X(SYNTH_PM_PIPE,   NOISE_NONE,   0, 1, CHAIN_PM)      \
+    X(SYNTH_PM_KICK,   NOISE_NONE,   0, 1, CHAIN_PM_DRUM) \
+    X(SYNTH_PM_SNARE,  NOISE_EXCITE, 1, 1, CHAIN_PM_DRUM) \
+    X(SYNTH_PM_HAT,    NOISE_EXCITE, 1, 1, CHAIN_PM_DRUM) \
+    X(SYNTH_PM_CLAP,   NOISE_EXCITE, 1, 1, CHAIN_PM_DRUM) \
+    X(SYNTH_PM_TOM,    NOISE_NONE,   0, 1, CHAIN_PM_DRUM)
+
+// Kernel stages are inlined into every kernel so that, with the type a
+// constant, their per-type switches and tests fold away.
+#if defined(__GNUC__)
+#define KERNEL_INLINE static inline __attribute__((always_inline))
+#else
+#define KERNEL_INLINE static inline
+#endif
+
+static VoiceKernel kernel_for(SynthType type);
+
+#define TRAIT_NOISE(type, noise, noise_hp, delay, chain) case type: return noise;
+#define TRAIT_NOISE_HP(type, noise, noise_hp, delay, chain) case type: return noise_hp;
+#define TRAIT_DELAY(type, noise, noise_hp, delay, chain) case type: return delay;
+#define TRAIT_CHAIN(type, noise, noise_hp, delay, chain) case type: return chain;
+
+KERNEL_INLINE NoiseKind noise_kind(SynthType t) {
+    switch (t) {
+        VOICE_KERNELS(TRAIT_NOISE)
+    }
+    return NOISE_NONE;
+}
+
+KERNEL_INLINE bool has_noise_hp(SynthType t) {
+    switch (t) {
+        VOICE_KERNELS(TRAIT_NOISE_HP)
+    }
+    return false;
+}
+
+KERNEL_INLINE bool has_delay(SynthType t) {
+    switch (t) {
+        VOICE_KERNELS(TRAIT_DELAY)
+    }
+    return false;
+}
+
+KERNEL_INLINE FilterChain filter_chain(SynthType t) {
+    switch (t) {
+        VOICE_KERNELS(TRAIT_CHAIN)
+    }
+    return CHAIN_PLAIN;
+}
+
+
+// Modulation
+//
+// Each mod runs either at audio rate (every sample) or at control rate: once
+// per control block its source, lag and slew are stepped a whole block ahead
+// and the destinations ramp linearly towards the new values. Env and noise
+// sources always run at audio rate, as does any mod marked `audio`; the rest
+// (LFO, S&H, ring, sync) are smooth or stepwise enough to interpolate.
+
+static bool mod_is_audio_rate(const ModDef *mod) {
+    return mod->audio_rate || mod->source == MOD_SRC_ENV || mod->source == MOD_SRC_NOISE;
+}
+
+// Per-mod increments and smoothing coefficients for one evaluation step:
+// a sample for audio-rate mods, a control block for the others.
+static void mod_setup(VoiceTemplate *tmpl, int idx, double sample_rate) {
+    const ModDef *mod = &tmpl->mods[idx];
+    int step = mod_is_audio_rate(mod) ? 1 : tmpl->voice.control_frames;
+    tmpl->mod_inc[idx] = dsp_phase_inc((double)mod->rate * step, sample_rate);
+    tmpl->mod_lag[idx] = 0.0f;
+    tmpl->mod_slew[idx] = 0.0f;
+    if (mod->lag_ms > 0.0f) {
+        tmpl->mod_lag[idx] = dsp_expf(-(float)step / (mod->lag_ms * 0.001f * (float)sample_rate));
+    }
+    if (mod->slew_ms > 0.0f) {
+        tmpl->mod_slew[idx] = (float)step / (mod->slew_ms * 0.001f * (float)sample_rate);
+    }
+}
+
+// Advances mod `idx` by one step and returns its new value.
+static float mod_source_value(Voice *voice, const ModDef *mod, int idx) {
+    VoiceCold *cold = voice->cold;
+    float val = 0.0f;
+    uint32_t phase_inc = cold->mod_inc[idx];
+    switch (mod->source) {
+        case MOD_SRC_LFO:
+            val = dsp_sin_phase(cold->mod_phase[idx]);
+            cold->mod_phase[idx] += phase_inc;
+            break;
+        case MOD_SRC_ENV:
+            val = (voice->env * 2.0f) - 1.0f;
+            break;
+        case MOD_SRC_NOISE:
+            voice->rng = voice->rng * 1664525u + 1013904223u;
+            val = ((voice->rng >> 8) / 8388608.0f) - 1.0f;
+            break;
+        case MOD_SRC_SAMPLE_HOLD: {
+            if (mod->rate <= 0.0f) {
+                val = cold->mod_hold[idx];
+            } else {
+                uint32_t prev = cold->mod_phase[idx];
+                cold->mod_phase[idx] += phase_inc;
+                if (cold->mod_phase[idx] < prev) {
+                    voice->rng = voice->rng * 1664525u + 1013904223u;
+                    cold->mod_hold[idx] = ((voice->rng >> 8) / 8388608.0f) - 1.0f;
+                }
+                val = cold->mod_hold[idx];
+            }
+            break;
+        }
+        case MOD_SRC_RING: {
+            float a = dsp_sin_phase(cold->mod_phase[idx]);
+            float b = dsp_sin_phase(cold->mod_phase[idx] * 2u);
+            val = a * b;
+            cold->mod_phase[idx] += phase_inc;
+            break;
+        }
+        case MOD_SRC_SYNC: {
+            float p = dsp_phase_turns(cold->mod_phase[idx]);
+            val = p * 2.0f - 1.0f;
+            cold->mod_phase[idx] += phase_inc;
+            break;
+        }
+    }
+    // Lag (one-pole)
+    if (mod->lag_ms > 0.0f) {
+        float alpha = cold->mod_lag[idx];
+        cold->mod_state[idx] = (1.0f - alpha) * val + alpha * cold->mod_state[idx];
+        val = cold->mod_state[idx];
+    }
+
+    // Slew (rate limit)
+    if (mod->slew_ms > 0.0f) {
+        float max_delta = cold->mod_slew[idx];
+        float delta = val - cold->mod_state[idx];
+        if (delta > max_delta) delta = max_delta;
+        if (delta < -max_delta) delta = -max_delta;
+        cold->mod_state[idx] += delta;
+        val = cold->mod_state[idx];
+    }
+
+    return val;
+}
+
+// Value of a control-rate mod at its current position, without stepping it.
+static float mod_current_value(const Voice *voice, const ModDef *mod, int idx) {
+    const VoiceCold *cold = voice->cold;
+    if (mod->lag_ms > 0.0f || mod->slew_ms > 0.0f) {
+        return cold->mod_state[idx];
+    }
+    uint32_t phase = cold->mod_phase[idx];
+    switch (mod->source) {
+        case MOD_SRC_LFO:
+            return dsp_sin_phase(phase);
+        case MOD_SRC_SAMPLE_HOLD:
+            return cold->mod_hold[idx];
+        case MOD_SRC_RING:
+            return dsp_sin_phase(phase) * dsp_sin_phase(phase * 2u);
+        case MOD_SRC_SYNC:
+            return dsp_phase_turns(phase) * 2.0f - 1.0f;
+        default:
+            return 0.0f;
+    }
+}
+
+// Folds per-mod values into destination values: amp as a gain, pitch as a
+// frequency ratio, the rest as sums.
+static void mod_dest_values(const Voice *voice, const float *vals, uint32_t mask, float *dest) {
+    const VoiceCold *cold = voice->cold;
+    float mod_amp = 1.0f;
+    float mod_pitch = 0.0f;
+    dest[MOD_DEST_CUTOFF] = 0.0f;
+    dest[MOD_DEST_RES] = 0.0f;
+    dest[MOD_DEST_PAN] = 0.0f;
+    for (int m = 0; m < voice->mod_count; m++) {
+        if (!(mask & (1u << m))) {
+            continue;
+        }
+        float mod = cold->mods[m].offset + cold->mods[m].depth * vals[m];
+        switch (cold->mods[m].dest) {
+            case MOD_DEST_AMP:
+                mod_amp *= (1.0f + mod);
+                break;
+            case MOD_DEST_PITCH:
+                mod_pitch += mod;
+                break;
+            default:
+                dest[cold->mods[m].dest] += mod;
+                break;
+        }
+    }
+    dest[MOD_DEST_AMP] = mod_amp;
+    dest[MOD_DEST_PITCH] = (mod_pitch != 0.0f) ? dsp_exp2f(mod_pitch / 12.0f) : 1.0f;
+}
+
+// Steps the control-rate mods one block ahead and points the destination
+// ramps at the result. The first block of a note (`note_start`) starts the
+// ramps from the mods' values at frame 0.
+static void mod_control_tick(Voice *voice, uint32_t control_mask, bool note_start) {
+    VoiceCold *cold = voice->cold;
+    float vals[32] = {0};
+    int mod_count = voice->mod_count;
+    if (note_start) {
+        for (int m = 0; m < mod_count; m++) {
+            if (control_mask & (1u << m)) {
+                vals[m] = mod_current_value(voice, &cold->mods[m], m);
+            }
+        }
+        mod_dest_values(voice, vals, control_mask, cold->mod_dest);
+    }
+    for (int m = 0; m < mod_count; m++) {
+        if (control_mask & (1u << m)) {
+            vals[m] = mod_source_value(voice, &cold->mods[m], m);
+        }
+    }
+    float target[VOICE_MOD_DESTS];
+    mod_dest_values(voice, vals, control_mask, target);
+    float inv = 1.0f / (float)voice->control_frames;
+    for (int d = 0; d < VOICE_MOD_DESTS; d++) {
+        cold->mod_dest_step[d] = (target[d] - cold->mod_dest[d]) * inv;
+    }
+}
+
+static float one_pole_alpha(float cutoff_hz, double sample_rate) {
+    return dsp_expf(-2.0f * (float)M_PI * fminf(cutoff_hz, (float)sample_rate * 0.45f) / (float)sample_rate);
+}
+
+// Coefficients of the filters whose corner doesn't follow the cutoff param:
+// the noise high-pass, the drum tone low-passes, the supersaw softener and the
+// PM body/output chains. They only depend on the synth type and sample rate.
+static void set_fixed_filters(Voice *voice, double sample_rate) {
+    float hp = 1200.0f, body = 0.0f, post_hp = 0.0f, post_lp = 0.0f;
+    switch (voice->type) {
+        case SYNTH_SNARE:
+        case SYNTH_SNARE808:
+        case SYNTH_SNARE909:
+            body = 2400.0f;
+            break;
+        case SYNTH_CLAP:
+        case SYNTH_CLAP909:
+            body = 2800.0f;
+            break;
+        case SYNTH_HAT_C:
+        case SYNTH_HAT_O:
+        case SYNTH_HAT808:
+        case SYNTH_HAT909:
+            body = 9000.0f;
+            break;
+        case SYNTH_SUPERSAW:
+            body = 7000.0f;
+            break;
+        case SYNTH_PM_SNARE:
+            body = 2400.0f; post_hp = 800.0f; post_lp = 3800.0f;
+            break;
+        case SYNTH_PM_CLAP:
+            body = 2800.0f; post_hp = 800.0f; post_lp = 3800.0f;
+            break;
+        case SYNTH_PM_HAT:
+            body = 9000.0f; post_hp = 5000.0f; post_lp = 12000.0f;
+            break;
+        case SYNTH_PM_KICK:
+        case SYNTH_PM_TOM:
+            body = 1800.0f;
+            break;
+        default:
+            post_hp = 400.0f; post_lp = 3800.0f;
+            break;
+    }
+    voice->hp_alpha = one_pole_alpha(hp, sample_rate);
+    voice->body_alpha = body > 0.0f ? one_pole_alpha(body, sample_rate) : 0.0f;
+    voice->post_hp_alpha = post_hp > 0.0f ? one_pole_alpha(post_hp, sample_rate) : 0.0f;
+    voice->post_lp_alpha = post_lp > 0.0f ? one_pole_alpha(post_lp, sample_rate) : 0.0f;
+}
+
+static void release_delay(Voice *voice) {
+    VoiceCold *cold = voice->cold;
+    if (cold->comb_buf) {
+        delay_pool_release(cold->delays, cold->comb_buf, cold->comb_len);
+        cold->comb_buf = NULL;
+    }
+}
+
+static int clamp_comb_len(int len) {
+    if (len < 8) len = 8;
+    if (len > COMB_MAX_SAMPLES) len = COMB_MAX_SAMPLES;
+    return len;
+}
+
+void voice_template_init(VoiceTemplate *tmpl, const SynthDef *synth, double sample_rate, int control_frames) {
+    memset(tmpl, 0, sizeof(*tmpl));
+    Voice *voice = &tmpl->voice;
+    SynthType type = synth->type;
+    voice->active = true;
+    voice->type = type;
+    voice->kernel = kernel_for(type);
+    voice->control_frames = control_frames > 0 ? control_frames : VOICE_CONTROL_FRAMES;
+    voice->stage = ENV_ATTACK;
+    voice->pitch_env = 1.0f;
+    voice->pitch_decay = (float)(1.0 / (0.03 * sample_rate));
+    set_fixed_filters(voice, sample_rate);
+    voice->sus = synth->sus;
+    voice->cutoff = synth->cutoff;
+    voice->res = synth->res;
+    voice->drive = synth->drive;
+    voice->amp = (type == SYNTH_COMB) ? synth->comb_excite : synth->amp;
+    tmpl->sample_rate = sample_rate;
+    tmpl->amp_gain = 1.0f;
+
+    if (type == SYNTH_HAT_C || type == SYNTH_HAT_O || type == SYNTH_HAT808 || type == SYNTH_HAT909) {
+        tmpl->fixed_freq = (type == SYNTH_HAT808) ? 7000.0f : 9000.0f;
+    }
+
+    if (has_delay(type)) {
+        if (type == SYNTH_PM_KICK) {
+            tmpl->amp_gain = 1.9f;
+        } else if (type == SYNTH_PM_TOM) {
+            tmpl->amp_gain = 1.7f;
+        } else if (type == SYNTH_PM_HAT) {
+            tmpl->amp_gain = 1.8f;
+        } else if (type == SYNTH_PM_SNARE || type == SYNTH_PM_CLAP) {
+            tmpl->amp_gain = 1.6f;
+        } else {
+            tmpl->amp_gain = 1.5f;
+        }
+        if (type == SYNTH_PM_KICK) {
+            tmpl->fixed_freq = 60.0f;
+            tmpl->comb_len = clamp_comb_len((int)(sample_rate / 55.0f));
+        } else if (type == SYNTH_PM_SNARE) {
+            tmpl->fixed_freq = 180.0f;
+            tmpl->comb_len = clamp_comb_len((int)(sample_rate / 180.0f));
+        } else if (type == SYNTH_PM_HAT) {
+            tmpl->fixed_freq = 9000.0f;
+            tmpl->comb_len = clamp_comb_len((int)(sample_rate / 7000.0f));
+        } else if (type == SYNTH_PM_CLAP) {
+            tmpl->fixed_freq = 240.0f;
+            tmpl->comb_len = clamp_comb_len((int)(sample_rate / 260.0f));
+        } else if (type == SYNTH_PM_TOM) {
+            tmpl->fixed_freq = 120.0f;
+            tmpl->comb_len = clamp_comb_len((int)(sample_rate / 120.0f));
+        }
+        float feedback = synth->comb_feedback;
+        float damp = synth->comb_damp;
+        if (type == SYNTH_PM_STRING) {
+            feedback = 0.88f;
+            damp = 0.18f;
+        } else if (type == SYNTH_PM_BELL) {
+            feedback = 0.94f;
+            damp = 0.12f;
+        } else if (type == SYNTH_PM_PIPE) {
+            feedback = 0.96f;
+            damp = 0.06f;
+        } else if (type == SYNTH_PM_KICK) {
+            feedback = 0.95f;
+            damp = 0.06f;
+        } else if (type == SYNTH_PM_SNARE) {
+            feedback = 0.88f;
+            damp = 0.28f;
+        } else if (type == SYNTH_PM_HAT) {
+            feedback = 0.75f;
+            damp = 0.6f;
+        } else if (type == SYNTH_PM_CLAP) {
+            feedback = 0.86f;
+            damp = 0.3f;
+        } else if (type == SYNTH_PM_TOM) {
+            feedback = 0.92f;
+            damp = 0.12f;
+        }
+
+        // Default PM material: wood (slightly more damp, slightly less feedback).
+        if (filter_chain(type) != CHAIN_PLAIN) {
+            feedback = fmaxf(0.5f, feedback * 0.93f);
+            damp = fminf(0.85f, damp + 0.08f);
+        }
+        if (type == SYNTH_PM_BELL || type == SYNTH_PM_PIPE) {
+            feedback = fmaxf(0.5f, feedback * 0.9f);
+            damp = fminf(0.9f, damp + 0.1f);
+        }
+        tmpl->comb_feedback = feedback;
+        tmpl->comb_damp = damp;
+    }
+
+    float atk = synth->atk;
+    float dec = synth->dec;
+    float rel = synth->rel;
+    if (type == SYNTH_KICK || type == SYNTH_KICK808 || type == SYNTH_KICK909) {
+        atk = 0.001f; dec = (type == SYNTH_KICK909 ? 0.18f : 0.26f);
+        voice->sus = 0.0f; rel = 0.05f;
+        voice->pitch_decay = (float)(1.0 / ((type == SYNTH_KICK909) ? 0.03 : 0.045) * sample_rate);
+    } else if (type == SYNTH_TOM) {
+        atk = 0.001f; dec = 0.18f; voice->sus = 0.0f; rel = 0.05f;
+        voice->pitch_decay = (float)(1.0 / (0.06 * sample_rate));
+    } else if (type == SYNTH_SNARE || type == SYNTH_SNARE808 || type == SYNTH_SNARE909) {
+        atk = 0.001f; dec = (type == SYNTH_SNARE909 ? 0.045f : 0.06f);
+        voice->sus = 0.0f; rel = 0.03f;
+    } else if (type == SYNTH_CLAP || type == SYNTH_CLAP909) {
+        atk = 0.001f; dec = (type == SYNTH_CLAP909 ? 0.06f : 0.07f);
+        voice->sus = 0.0f; rel = 0.04f;
+    } else if (type == SYNTH_HAT_C || type == SYNTH_HAT808) {
+        atk = 0.001f; dec = 0.018f; voice->sus = 0.0f; rel = 0.012f;
+    } else if (type == SYNTH_HAT_O || type == SYNTH_HAT909) {
+        atk = 0.001f; dec = 0.07f; voice->sus = 0.0f; rel = 0.045f;
+    } else if (type == SYNTH_RIM || type == SYNTH_GLITCH || type == SYNTH_BITPERC) {
+        atk = 0.001f; dec = 0.03f; voice->sus = 0.0f; rel = 0.02f;
+    } else if (type == SYNTH_METAL) {
+        atk = 0.002f; dec = 0.12f; voice->sus = 0.0f; rel = 0.06f;
+    } else if (type == SYNTH_PM_KICK) {
+        atk = 0.001f; dec = 0.2f; voice->sus = 0.0f; rel = 0.08f;
+        voice->pitch_decay = (float)(1.0 / (0.05 * sample_rate));
+    } else if (type == SYNTH_PM_SNARE) {
+        atk = 0.001f; dec = 0.07f; voice->sus = 0.0f; rel = 0.04f;
+    } else if (type == SYNTH_PM_HAT) {
+        atk = 0.001f; dec = 0.03f; voice->sus = 0.0f; rel = 0.02f;
+    } else if (type == SYNTH_PM_CLAP) {
+        atk = 0.001f; dec = 0.06f; voice->sus = 0.0f; rel = 0.04f;
+    } else if (type == SYNTH_PM_TOM) {
+        atk = 0.001f; dec = 0.14f; voice->sus = 0.0f; rel = 0.06f;
+    } else if (type == SYNTH_COMB || type == SYNTH_PM_STRING || type == SYNTH_PM_BELL || type == SYNTH_PM_PIPE) {
+        atk = 0.001f; dec = 0.4f; voice->sus = 0.0f; rel = 0.2f;
+    }
+    voice->atk_inc = atk <= 0.0001f ? 1.0f : (1.0f / (float)(atk * sample_rate));
+    voice->dec_inc = dec <= 0.0001f ? 1.0f : ((1.0f - voice->sus) / (float)(dec * sample_rate));
+    voice->rel_inc = rel <= 0.0001f ? 1.0f : (1.0f / (float)(rel * sample_rate));
+    tmpl->accent_gain = 1.0f;
+    tmpl->accent_dec_inc = voice->dec_inc;
+    tmpl->accent_rel_inc = voice->rel_inc;
+    if (type == SYNTH_ACID) {
+        dec *= 0.7f;
+        rel *= 0.7f;
+        tmpl->accent_gain = 1.15f;
+        tmpl->accent_dec_inc = dec <= 0.0001f ? 1.0f : ((1.0f - voice->sus) / (float)(dec * sample_rate));
+        tmpl->accent_rel_inc = rel <= 0.0001f ? 1.0f : (1.0f / (float)(rel * sample_rate));
+    }
+
+    tmpl->detune_rate = synth->detune_rate;
+    tmpl->detune_depth = synth->detune_depth;
+    if (type == SYNTH_SUPERSAW) {
+        // Spread the starting phases so the unison doesn't start as one saw.
+        for (int k = 0; k < SUPERSAW_VOICES; k++) {
+            tmpl->unison_phase[k] = dsp_turns_phase((float)k * RAD_TO_TURNS(0.47f));
+            tmpl->unison_lfo_phase[k] = dsp_turns_phase((float)k * RAD_TO_TURNS(1.3f));
+        }
+    }
+
+    voice->mod_count = synth->mod_count < 32 ? synth->mod_count : 32;
+    for (int i = 0; i < voice->mod_count; i++) {
+        tmpl->mods[i] = synth->mods[i];
+        mod_setup(tmpl, i, sample_rate);
+        if (mod_is_audio_rate(&tmpl->mods[i])) {
+            tmpl->mod_audio_mask |= 1u << i;
+        }
+    }
+}
+
+void voice_note_on(Voice *voice,
+                   const VoiceTemplate *tmpl,
+                   float freq,
+                   int gate_samples,
+                   float amp_scale,
+                   int glide_samples,
+                   int accent) {
+    VoiceCold *cold = voice->cold;
+    release_delay(voice);
+    float prev_freq = voice->freq;
+    uint32_t rng = voice->rng;
+    *voice = tmpl->voice;
+    voice->cold = cold;
+    cold->tmpl = tmpl;
+
+    voice->gate_samples = gate_samples;
+    voice->rng = rng ^ (uint32_t)(freq * 1000.0f);
+    voice->amp *= amp_scale;
+    voice->amp *= tmpl->amp_gain;
+    cold->amp_scale = amp_scale * tmpl->amp_gain;
+    if (accent) {
+        voice->accent = 1.0f;
+        voice->amp *= tmpl->accent_gain;
+        cold->amp_scale *= tmpl->accent_gain;
+        voice->dec_inc = tmpl->accent_dec_inc;
+        voice->rel_inc = tmpl->accent_rel_inc;
+    }
+    if (tmpl->fixed_freq > 0.0f) {
+        voice->freq = tmpl->fixed_freq;
+    } else if (glide_samples > 0) {
+        voice->freq = prev_freq;
+        voice->glide_samples = glide_samples;
+        voice->glide_step = (freq - prev_freq) / (float)glide_samples;
+    } else {
+        voice->freq = freq;
+    }
+
+    if (voice->type == SYNTH_SUPERSAW) {
+        cold->detune_rate = tmpl->detune_rate;
+        cold->detune_depth = tmpl->detune_depth;
+        memcpy(cold->unison_phase, tmpl->unison_phase, sizeof(cold->unison_phase));
+        memcpy(cold->unison_lfo_phase, tmpl->unison_lfo_phase, sizeof(cold->unison_lfo_phase));
+        cold->unison_countdown = 0;
+    }
+
+    int mod_count = voice->mod_count;
+    if (mod_count > 0) {
+        size_t n = (size_t)mod_count;
+        cold->mod_audio_mask = tmpl->mod_audio_mask;
+        cold->mod_countdown = 0;
+        memcpy(cold->mods, tmpl->mods, n * sizeof(ModDef));
+        memcpy(cold->mod_inc, tmpl->mod_inc, n * sizeof(uint32_t));
+        memcpy(cold->mod_lag, tmpl->mod_lag, n * sizeof(float));
+        memcpy(cold->mod_slew, tmpl->mod_slew, n * sizeof(float));
+        memset(cold->mod_phase, 0, n * sizeof(uint32_t));
+        memset(cold->mod_hold, 0, n * sizeof(float));
+        memset(cold->mod_state, 0, n * sizeof(float));
+    }
+
+    if (has_delay(voice->type)) {
+        int len = tmpl->comb_len;
+        if (len == 0) {
+            len = clamp_comb_len((int)(tmpl->sample_rate / fmaxf(freq, 40.0f)));
+        }
+        cold->comb_len = len;
+        cold->comb_idx = 0;
+        cold->comb_fresh = len;
+        cold->comb_feedback = tmpl->comb_feedback;
+        cold->comb_damp = tmpl->comb_damp;
+        cold->comb_state = 0.0f;
+        cold->crush_hold = 0.0f;
+        cold->crush_count = 0;
+        cold->comb_buf = delay_pool_acquire(cold->delays, len);
+        if (!cold->comb_buf) {
+            voice->active = false;
+        }
+    }
+}
+
+void voice_fade_out(Voice *voice, int frames) {
+    if (frames < 1) {
+        frames = 1;
+    }
+    voice->stage = ENV_RELEASE;
+    voice->gate_samples = 0;
+    voice->rel_inc = fmaxf(voice->env, 1e-6f) / (float)frames;
+}
+
+
+// Block rendering
+//
+// A voice chunk is processed in stages. voice_control() runs the inherently
+// serial per-sample work (envelope, glide, modulation, noise draws, phase
+// accumulation) and records what the later stages need into VoiceScratch.
+// The oscillator, filter and output stages then run as separate loops with
+// fixed filter coefficients set up at note-on. Voices whose filters share
+// state within a sample (the PM types) use fused per-group filter chains
+// instead. Each synth type renders through its own kernel (see
+// VOICE_KERNELS), so the stages see a constant type and carry no type tests.
+
+typedef struct {
+    float env[VOICE_BLOCK_FRAMES];
+    float pitch_env[VOICE_BLOCK_FRAMES];
+    uint32_t phase[VOICE_BLOCK_FRAMES];      // oscillator phase seen by this sample
+    uint32_t phase_next[VOICE_BLOCK_FRAMES]; // phase after this sample's increment
+    uint32_t phase_inc[VOICE_BLOCK_FRAMES];
+    float noise[VOICE_BLOCK_FRAMES];
+    float amp[VOICE_BLOCK_FRAMES];
+    float cutoff[VOICE_BLOCK_FRAMES];
+    float res[VOICE_BLOCK_FRAMES];
+    float pan[VOICE_BLOCK_FRAMES];
+    float coef[VOICE_BLOCK_FRAMES]; // cutoff-tracking filter coefficient
+    float sig[VOICE_BLOCK_FRAMES];
+} VoiceScratch;
+
+KERNEL_INLINE void one_pole_lp_block(float *x, int n, float alpha, float *state) {
+    float beta = 1.0f - alpha;
+    float s = *state;
+    for (int i = 0; i < n; i++) {
+        s = beta * x[i] + alpha * s;
+        x[i] = s;
+    }
+    *state = s;
+}
+
+KERNEL_INLINE void one_pole_hp_block(float *x, int n, float alpha, float *state) {
+    float beta = 1.0f - alpha;
+    float s = *state;
+    for (int i = 0; i < n; i++) {
+        s = beta * x[i] + alpha * s;
+        x[i] = x[i] - s;
+    }
+    *state = s;
+}
+
+KERNEL_INLINE int voice_control(Voice *voice, VoiceScratch *s, int frames, double sample_rate, NoiseKind noise) {
+    VoiceCold *cold = voice->cold;
+    int mod_count = voice->mod_count;
+    uint32_t mod_mask = mod_count < 32 ? (1u << mod_count) - 1u : 0xFFFFFFFFu;
+    uint32_t audio_mask = mod_count > 0 ? cold->mod_audio_mask : 0;
+    uint32_t control_mask = mod_mask & ~audio_mask;
+    float inc_freq = 0.0f;
+    uint32_t phase_inc = 0;
+    bool inc_valid = false;
+    int n = frames;
+
+    for (int i = 0; i < frames; i++) {
+        if (voice->stage == ENV_ATTACK) {
+            voice->env += voice->atk_inc;
+            if (voice->env >= 1.0f) {
+                voice->env = 1.0f;
+                voice->stage = ENV_DECAY;
+            }
+        } else if (voice->stage == ENV_DECAY) {
+            voice->env -= voice->dec_inc;
+            if (voice->env <= voice->sus) {
+                voice->env = voice->sus;
+                voice->stage = ENV_SUSTAIN;
+            }
+        } else if (voice->stage == ENV_SUSTAIN) {
+            if (voice->gate_samples <= 0) {
+                voice->stage = ENV_RELEASE;
+            }
+        } else if (voice->stage == ENV_RELEASE) {
+            voice->env -= voice->rel_inc;
+            if (voice->env <= 0.0f) {
+                voice->env = 0.0f;
+                voice->stage = ENV_OFF;
+                voice->active = false;
+                n = i;
+                break;
+            }
+        }
+
+        voice->gate_samples--;
+
+        if (voice->glide_samples > 0) {
+            voice->freq += voice->glide_step;
+            voice->glide_samples--;
+        }
+        if (voice->pitch_env > 0.0f) {
+            voice->pitch_env -= voice->pitch_decay;
+            if (voice->pitch_env < 0.0f) voice->pitch_env = 0.0f;
+        }
+
+        float freq = voice->freq;
+        if (mod_count > 0) {
+            if (cold->mod_countdown <= 0) {
+                mod_control_tick(voice, control_mask, voice->age + i == 0);
+                cold->mod_countdown = voice->control_frames;
+            }
+            cold->mod_countdown--;
+            float mod_amp = cold->mod_dest[MOD_DEST_AMP];
+            float mod_cutoff = cold->mod_dest[MOD_DEST_CUTOFF];
+            float mod_res = cold->mod_dest[MOD_DEST_RES];
+            float mod_pan = cold->mod_dest[MOD_DEST_PAN];
+            float pitch_ratio = cold->mod_dest[MOD_DEST_PITCH];
+            for (int d = 0; d < VOICE_MOD_DESTS; d++) {
+                cold->mod_dest[d] += cold->mod_dest_step[d];
+            }
+
+            if (audio_mask) {
+                float mod_pitch = 0.0f;
+                for (int m = 0; m < mod_count; m++) {
+                    if (!(audio_mask & (1u << m))) {
+                        continue;
+                    }
+                    float val = mod_source_value(voice, &cold->mods[m], m);
+                    float mod = cold->mods[m].offset + cold->mods[m].depth * val;
+                    switch (cold->mods[m].dest) {
+                        case MOD_DEST_AMP:
+                            mod_amp *= (1.0f + mod);
+                            break;
+                        case MOD_DEST_CUTOFF:
+                            mod_cutoff += mod;
+                            break;
+                        case MOD_DEST_RES:
+                            mod_res += mod;
+                            break;
+                        case MOD_DEST_PAN:
+                            mod_pan += mod;
+                            break;
+                        case MOD_DEST_PITCH:
+                            mod_pitch += mod;
+                            break;
+                    }
+                }
+                if (mod_pitch != 0.0f) {
+                    pitch_ratio *= dsp_exp2f(mod_pitch / 12.0f);
+                }
+            }
+
+            if (pitch_ratio != 1.0f) {
+                freq = voice->freq * pitch_ratio;
+            }
+            voice->pan = fmaxf(-1.0f, fminf(1.0f, mod_pan));
+
+            float cutoff = voice->cutoff + mod_cutoff;
+            if (cutoff < 10.0f) cutoff = 10.0f;
+            float amp = voice->amp * mod_amp;
+            if (amp < 0.0f) amp = 0.0f;
+            s->cutoff[i] = cutoff;
+            s->res[i] = fminf(0.99f, fmaxf(0.0f, voice->res + mod_res));
+            s->amp[i] = amp;
+            s->pan[i] = voice->pan;
+        }
+
+        // Noise is drawn here, after the mod sources, so the shared RNG
+        // advances in the same order as a sample-at-a-time voice.
+        if (noise == NOISE_LCG || (noise == NOISE_EXCITE && voice->age + i < 96)) {
+            voice->rng = voice->rng * 1664525u + 1013904223u;
+            s->noise[i] = ((voice->rng >> 8) / 8388608.0f) - 1.0f;
+        } else if (noise == NOISE_GLITCH) {
+            voice->rng = voice->rng * 1103515245u + 12345u;
+            s->noise[i] = ((voice->rng >> 8) / 8388608.0f) - 1.0f;
+        }
+
+        s->phase[i] = voice->phase;
+        if (!inc_valid || freq != inc_freq) {
+            inc_freq = freq;
+            phase_inc = dsp_phase_inc(freq, sample_rate);
+            inc_valid = true;
+        }
+        voice->phase += phase_inc;
+        s->phase_next[i] = voice->phase;
+        s->phase_inc[i] = phase_inc;
+
+        s->env[i] = voice->env;
+        s->pitch_env[i] = voice->pitch_env;
+    }
+
+    if (mod_count == 0) {
+        // Unmodulated: cutoff, resonance, amp and pan are constant.
+        voice->pan = 0.0f;
+        float cutoff = voice->cutoff;
+        if (cutoff < 10.0f) cutoff = 10.0f;
+        float amp = voice->amp;
+        if (amp < 0.0f) amp = 0.0f;
+        float res = fminf(0.99f, fmaxf(0.0f, voice->res));
+        for (int i = 0; i < n; i++) {
+            s->cutoff[i] = cutoff;
+            s->res[i] = res;
+            s->amp[i] = amp;
+            s->pan[i] = 0.0f;
+        }
+    }
+    return n;
+}
+
+KERNEL_INLINE void render_pm_excitation(const Voice *voice, VoiceScratch *s, int n, SynthType type) {
+    float *out = s->sig;
+    int burst = 96 - voice->age;
+    if (burst < 0) burst = 0;
+    if (burst > n) burst = n;
+    float amp = voice->amp;
+    const uint32_t *ph = s->phase;
+    const float *nz = s->noise;
+
+    switch (type) {
+        case SYNTH_PM_BELL:
+            for (int i = 0; i < burst; i++) {
+                float excite = 1.0f - (float)(voice->age + i) / 96.0f;
+                out[i] = dsp_sin_phase(ph[i] * 6u) * amp * excite;
+            }
+            break;
+        case SYNTH_PM_KICK:
+            for (int i = 0; i < burst; i++) {
+                float excite = 1.0f - (float)(voice->age + i) / 96.0f;
+                out[i] = dsp_sin_turns(dsp_phase_turns(ph[i]) * 1.1f) * amp * (0.8f + excite);
+            }
+            break;
+        case SYNTH_PM_SNARE:
+            for (int i = 0; i < burst; i++) {
+                float excite = 1.0f - (float)(voice->age + i) / 96.0f;
+                out[i] = nz[i] * amp * (0.7f + excite);
+            }
+            break;
+        case SYNTH_PM_HAT:
+            for (int i = 0; i < burst; i++) {
+                float excite = 1.0f - (float)(voice->age + i) / 96.0f;
+                float t = dsp_phase_turns(ph[i]);
+                float m1 = dsp_sin_turns(t * 2.8f);
+                float m2 = dsp_sin_turns(t * 5.3f);
+                float m3 = dsp_sin_turns(t * 9.1f);
+                out[i] = (nz[i] * 0.65f + (m1 + m2 + m3) * 0.14f) * amp * (0.7f + excite);
+            }
+            break;
+        case SYNTH_PM_CLAP:
+            for (int i = 0; i < burst; i++) {
+                float excite = 1.0f - (float)(voice->age + i) / 96.0f;
+                float t = dsp_phase_turns(ph[i]);
+                float m1 = dsp_sin_turns(t * 3.6f);
+                float m2 = dsp_sin_turns(t * 6.7f);
+                out[i] = (nz[i] * 0.55f + (m1 + m2) * 0.16f) * amp * (0.7f + excite);
+            }
+            break;
+        case SYNTH_PM_TOM:
+            for (int i = 0; i < burst; i++) {
+                float excite = 1.0f - (float)(voice->age + i) / 96.0f;
+                out[i] = dsp_sin_turns(dsp_phase_turns(ph[i]) * 1.6f) * amp * (0.7f + excite);
+            }
+            break;
+        case SYNTH_PM_PIPE:
+            for (int i = 0; i < burst; i++) {
+                float excite = 1.0f - (float)(voice->age + i) / 96.0f;
+                out[i] = dsp_sin_phase(ph[i] * 2u) * amp * excite;
+            }
+            break;
+        default:
+            for (int i = 0; i < burst; i++) {
+                float excite = 1.0f - (float)(voice->age + i) / 96.0f;
+                out[i] = nz[i] * amp * excite;
+            }
+            break;
+    }
+    for (int i = burst; i < n; i++) {
+        out[i] = 0.0f;
+    }
+}
+
+KERNEL_INLINE void render_comb(Voice *voice, float *x, int n) {
+    VoiceCold *cold = voice->cold;
+    float *buf = cold->comb_buf;
+    int idx = cold->comb_idx;
+    int len = cold->comb_len;
+    float damp = cold->comb_damp;
+    float undamp = 1.0f - damp;
+    float fb = cold->comb_feedback;
+    float state = cold->comb_state;
+    // A new line isn't cleared; until it has been written once, the delayed
+    // input is silence.
+    int fresh = cold->comb_fresh < n ? cold->comb_fresh : n;
+    for (int i = 0; i < fresh; i++) {
+        float y = 0.0f;
+        state = undamp * y + damp * state;
+        buf[idx] = dsp_flush_denormal(x[i] + state * fb);
+        idx = (idx + 1) % len;
+        x[i] = state;
+    }
+    cold->comb_fresh -= fresh;
+    for (int i = fresh; i < n; i++) {
+        float y = buf[idx];
+        state = undamp * y + damp * state;
+        buf[idx] = dsp_flush_denormal(x[i] + state * fb);
+        idx = (idx + 1) % len;
+        x[i] = state;
+    }
+    cold->comb_idx = idx;
+    cold->comb_state = state;
+}
+
+// Refreshes the unison pitch ratios from the slow detune LFOs.
+static void supersaw_update_detune(Voice *voice, double sample_rate) {
+    VoiceCold *cold = voice->cold;
+    static const float detune_cents[SUPERSAW_VOICES] = {-20.0f, -15.0f, -10.0f, -6.0f, -3.0f, 3.0f, 6.0f, 10.0f, 15.0f, 20.0f};
+    for (int k = 0; k < SUPERSAW_VOICES; k++) {
+        float lfo_rate = cold->detune_rate * (0.7f + 0.06f * (float)k);
+        float lfo = dsp_sin_phase(cold->unison_lfo_phase[k]);
+        cold->unison_lfo_phase[k] += dsp_phase_inc((double)lfo_rate * voice->control_frames, sample_rate);
+        float detune = detune_cents[k] + lfo * cold->detune_depth;
+        cold->unison_ratio[k] = dsp_exp2f(detune / 1200.0f);
+    }
+}
+
+// Each unison saw runs its own accumulator at the voice increment times its
+// ratio, so detune changes bend pitch without jumping phase. Sub-increments
+// are only recomputed when the ratios or the voice increment change.
+KERNEL_INLINE void render_supersaw(Voice *voice, VoiceScratch *s, int n, double sample_rate) {
+    VoiceCold *cold = voice->cold;
+    uint32_t sub_inc[SUPERSAW_VOICES];
+    uint32_t base_inc = 0;
+    bool inc_valid = false;
+    for (int i = 0; i < n; i++) {
+        if (cold->unison_countdown <= 0) {
+            supersaw_update_detune(voice, sample_rate);
+            cold->unison_countdown = voice->control_frames;
+            inc_valid = false;
+        }
+        cold->unison_countdown--;
+        if (!inc_valid || s->phase_inc[i] != base_inc) {
+            base_inc = s->phase_inc[i];
+            for (int k = 0; k < SUPERSAW_VOICES; k++) {
+                sub_inc[k] = (uint32_t)(int64_t)((double)(int32_t)base_inc * (double)cold->unison_ratio[k]);
+            }
+            inc_valid = true;
+        }
+        float sum = 0.0f;
+        for (int k = 0; k < SUPERSAW_VOICES; k++) {
+            sum += dsp_saw_phase(cold->unison_phase[k]);
+            cold->unison_phase[k] += sub_inc[k];
+        }
+        s->sig[i] = sum / (float)SUPERSAW_VOICES;
+    }
+}
+
+KERNEL_INLINE void render_osc(Voice *voice, VoiceScratch *s, int n, double sample_rate, SynthType type) {
+    float *out = s->sig;
+    const uint32_t *ph = s->phase;
+    const float *nz = s->noise;
+
+    switch (type) {
+        case SYNTH_SINE:
+            for (int i = 0; i < n; i++) {
+                out[i] = dsp_sin_phase(ph[i]);
+            }
+            break;
+        case SYNTH_SAW:
+        case SYNTH_ACID:
+            for (int i = 0; i < n; i++) {
+                out[i] = dsp_saw_phase(ph[i]);
+            }
+            break;
+        case SYNTH_SUPERSAW:
+            render_supersaw(voice, s, n, sample_rate);
+            break;
+        case SYNTH_SQUARE:
+            for (int i = 0; i < n; i++) {
+                out[i] = (ph[i] < 0x80000000u) ? 1.0f : -1.0f;
+            }
+            break;
+        case SYNTH_TRI:
+            for (int i = 0; i < n; i++) {
+                out[i] = 2.0f * fabsf(dsp_saw_phase(ph[i])) - 1.0f;
+            }
+            break;
+        case SYNTH_NOISE:
+        case SYNTH_SNARE:
+        case SYNTH_SNARE808:
+        case SYNTH_SNARE909:
+        case SYNTH_CLAP:
+        case SYNTH_CLAP909:
+        case SYNTH_RIM:
+            for (int i = 0; i < n; i++) {
+                out[i] = nz[i];
+            }
+            break;
+        case SYNTH_PULSE: {
+            for (int i = 0; i < n; i++) {
+                out[i] = (ph[i] < VOICE_PULSE_EDGE) ? 1.0f : -1.0f;
+            }
+            break;
+        }
+        case SYNTH_FM:
+            for (int i = 0; i < n; i++) {
+                float mod = dsp_sin_phase(ph[i] * 2u);
+                out[i] = dsp_sin_phase(ph[i] + dsp_turns_phase(mod * RAD_TO_TURNS(2.5f)));
+            }
+            break;
+        case SYNTH_FM2:
+            for (int i = 0; i < n; i++) {
+                float mod1 = dsp_sin_phase(ph[i] * 3u);
+                float mod2 = dsp_sin_phase(ph[i] * 7u + dsp_turns_phase(mod1 * RAD_TO_TURNS(2.0f)));
+                out[i] = dsp_sin_phase(ph[i] + dsp_turns_phase(mod2 * RAD_TO_TURNS(3.0f)));
+            }
+            break;
+        case SYNTH_RING:
+            for (int i = 0; i < n; i++) {
+                out[i] = dsp_sin_phase(ph[i]) * dsp_saw_phase(ph[i]);
+            }
+            break;
+        case SYNTH_KICK:
+        case SYNTH_KICK808:
+        case SYNTH_KICK909:
+            for (int i = 0; i < n; i++) {
+                float drop = 1.0f + s->pitch_env[i] * 4.2f;
+                out[i] = dsp_sin_turns(dsp_phase_turns(ph[i]) * drop);
+            }
+            break;
+        case SYNTH_TOM:
+            for (int i = 0; i < n; i++) {
+                float drop = 1.0f + s->pitch_env[i] * 1.5f;
+                out[i] = dsp_sin_turns(dsp_phase_turns(ph[i]) * drop);
+            }
+            break;
+        case SYNTH_HAT_C:
+        case SYNTH_HAT_O:
+        case SYNTH_HAT808:
+        case SYNTH_HAT909:
+            for (int i = 0; i < n; i++) {
+                float t = dsp_phase_turns(ph[i]);
+                float m1 = dsp_sin_turns(t * 2.2f);
+                float m2 = dsp_sin_turns(t * 3.4f);
+                float m3 = dsp_sin_turns(t * 5.1f);
+                float m4 = dsp_sin_phase(ph[i] * 8u);
+                out[i] = nz[i] * 0.5f + (m1 + m2 + m3 + m4) * 0.1f;
+            }
+            break;
+        case SYNTH_GLITCH:
+            for (int i = 0; i < n; i++) {
+                float stepped = floorf(nz[i] * 6.0f) / 6.0f;
+                out[i] = stepped * (dsp_sin_phase(ph[i] * 4u) * 0.6f + 0.4f);
+            }
+            break;
+        case SYNTH_METAL:
+            for (int i = 0; i < n; i++) {
+                float a = dsp_sin_phase(ph[i] * 2u);
+                float b = dsp_sin_phase(ph[i] * 3u + dsp_turns_phase(a * RAD_TO_TURNS(1.5f)));
+                float c = dsp_sin_phase(ph[i] * 5u + dsp_turns_phase(b * RAD_TO_TURNS(1.2f)));
+                out[i] = (a + b + c) * 0.33f;
+            }
+            break;
+        case SYNTH_BITPERC:
+            for (int i = 0; i < n; i++) {
+                out[i] = floorf(nz[i] * 8.0f) / 8.0f;
+            }
+            break;
+        case SYNTH_COMB:
+        case SYNTH_PM_STRING:
+        case SYNTH_PM_BELL:
+        case SYNTH_PM_PIPE:
+        case SYNTH_PM_KICK:
+        case SYNTH_PM_SNARE:
+        case SYNTH_PM_HAT:
+        case SYNTH_PM_CLAP:
+        case SYNTH_PM_TOM:
+            render_pm_excitation(voice, s, n, type);
+            render_comb(voice, out, n);
+            break;
+    }
+}
+
+// Exact coefficient of the cutoff-tracking filter at frame i: the acid SVF
+// frequency (which also follows the envelope), or the default one-pole alpha.
+KERNEL_INLINE float cutoff_coef_at(const Voice *voice, const VoiceScratch *s, int i, double sample_rate,
+                                   SynthType type) {
+    if (type == SYNTH_ACID) {
+        float accent = voice->accent;
+        float cut = s->cutoff[i] + s->env[i] * (2600.0f + accent * 800.0f) + accent * 200.0f;
+        float max_cut = (float)sample_rate * 0.45f;
+        return 2.0f * dsp_sin_turns(0.5f * fminf(cut, max_cut) / (float)sample_rate);
+    }
+    return dsp_expf(-2.0f * (float)M_PI * s->cutoff[i] / (float)sample_rate);
+}
+
+// Per-sample cutoff coefficients into out[i * stride]. The exact value is
+// computed once per control block of voice age and the coefficient ramps
+// linearly towards it, so a modulated cutoff costs one transcendental per
+// control block. A constant cutoff yields a constant, exact coefficient.
+KERNEL_INLINE void fill_cutoff_coef(Voice *voice, const VoiceScratch *s, int n, double sample_rate,
+                                    SynthType type, float *out, int stride) {
+    float coef = voice->cutoff_coef;
+    float step = voice->cutoff_coef_step;
+    int countdown = voice->coef_countdown;
+    for (int i = 0; i < n; i++) {
+        if (countdown <= 0) {
+            float target = cutoff_coef_at(voice, s, i, sample_rate, type);
+            if (voice->age + i == 0) {
+                coef = target;
+                step = 0.0f;
+            } else {
+                step = (target - coef) / (float)voice->control_frames;
+            }
+            countdown = voice->control_frames;
+        }
+        out[i * stride] = coef;
+        coef += step;
+        countdown--;
+    }
+    voice->cutoff_coef = coef;
+    voice->cutoff_coef_step = step;
+    voice->coef_countdown = countdown;
+}
+
+KERNEL_INLINE void render_acid_filter(Voice *voice, VoiceScratch *s, int n, double sample_rate) {
+    float *x = s->sig;
+    float accent = voice->accent;
+    float res_offset = accent * 0.1f;
+    float gain = 2.0f + accent * 0.55f;
+    fill_cutoff_coef(voice, s, n, sample_rate, SYNTH_ACID, s->coef, 1);
+    float lp = voice->svf_lp;
+    float bp = voice->svf_bp;
+    for (int i = 0; i < n; i++) {
+        float r = fminf(0.97f, s->res[i] + res_offset);
+        float f = s->coef[i];
+        float q = fmaxf(0.1f, 1.0f - r);
+        // Two passes per sample (2x oversample approx).
+        float in = x[i];
+        for (int pass = 0; pass < 2; pass++) {
+            lp += f * bp;
+            float hp = in - lp - q * bp;
+            bp += f * hp;
+            in = lp;
+        }
+        x[i] = lp;
+    }
+    voice->svf_lp = lp;
+    voice->svf_bp = bp;
+    for (int i = 0; i < n; i++) {
+        x[i] = dsp_tanhf(x[i] * gain);
+    }
+}
+
+KERNEL_INLINE void render_filters(Voice *voice, VoiceScratch *s, int n, double sample_rate, SynthType type) {
+    float *x = s->sig;
+
+    if (has_noise_hp(type)) {
+        one_pole_hp_block(x, n, voice->hp_alpha, &voice->hp_state);
+    }
+
+    switch (type) {
+        case SYNTH_ACID:
+            render_acid_filter(voice, s, n, sample_rate);
+            break;
+        case SYNTH_SNARE:
+        case SYNTH_SNARE808:
+        case SYNTH_SNARE909:
+            one_pole_lp_block(x, n, voice->body_alpha, &voice->filter_state);
+            for (int i = 0; i < n; i++) {
+                float tone = dsp_sin_phase(s->phase_next[i] >> 1);
+                x[i] = x[i] * 0.55f + tone * 0.45f;
+            }
+            break;
+        case SYNTH_CLAP:
+        case SYNTH_CLAP909:
+            one_pole_lp_block(x, n, voice->body_alpha, &voice->filter_state);
+            for (int i = 0; i < n; i++) {
+                float t = (float)(voice->age + i) / (float)sample_rate;
+                float gate = (t < 0.006f || (t > 0.012f && t < 0.02f) || (t > 0.026f && t < 0.034f)) ? 1.0f : 0.2f;
+                x[i] = x[i] * gate;
+            }
+            break;
+        case SYNTH_HAT_C:
+        case SYNTH_HAT_O:
+        case SYNTH_HAT808:
+        case SYNTH_HAT909:
+            one_pole_lp_block(x, n, voice->body_alpha, &voice->filter_state);
+            break;
+        default: {
+            fill_cutoff_coef(voice, s, n, sample_rate, type, s->coef, 1);
+            float state = voice->filter_state;
+            for (int i = 0; i < n; i++) {
+                float alpha = s->coef[i];
+                state = (1.0f - alpha) * x[i] + alpha * state;
+                x[i] = state;
+            }
+            voice->filter_state = state;
+            break;
+        }
+    }
+
+    if (type == SYNTH_SUPERSAW) {
+        // Gentle softening of the top end without shrinking the body.
+        one_pole_lp_block(x, n, voice->body_alpha, &voice->supersaw_lp);
+    }
+}
+
+// PM voices run their body filter, saturation and output filters on shared
+// state within each sample, so each PM group gets one fused chain.
+KERNEL_INLINE void render_pm_filters(Voice *voice, VoiceScratch *s, int n, double sample_rate, SynthType type) {
+    VoiceCold *cold = voice->cold;
+    float *x = s->sig;
+    float hp = voice->hp_state;
+    float lp = voice->filter_state;
+
+    switch (type) {
+        case SYNTH_PM_SNARE: {
+            float a0 = voice->hp_alpha, b0 = 1.0f - a0;
+            float a1 = voice->body_alpha, b1 = 1.0f - a1;
+            float a2 = voice->post_hp_alpha, b2 = 1.0f - a2;
+            float a3 = voice->post_lp_alpha, b3 = 1.0f - a3;
+            for (int i = 0; i < n; i++) {
+                hp = b0 * x[i] + a0 * hp;
+                float y = x[i] - hp;
+                lp = b1 * y + a1 * lp;
+                float tone = dsp_sin_phase(s->phase_next[i] >> 1);
+                y = dsp_tanhf((lp * 0.55f + tone * 0.45f) * 1.6f);
+                hp = b2 * y + a2 * hp;
+                lp = b3 * (y - hp) + a3 * lp;
+                x[i] = lp;
+            }
+            break;
+        }
+        case SYNTH_PM_CLAP: {
+            float a0 = voice->hp_alpha, b0 = 1.0f - a0;
+            float a1 = voice->body_alpha, b1 = 1.0f - a1;
+            float a2 = voice->post_hp_alpha, b2 = 1.0f - a2;
+            float a3 = voice->post_lp_alpha, b3 = 1.0f - a3;
+            for (int i = 0; i < n; i++) {
+                hp = b0 * x[i] + a0 * hp;
+                float y = x[i] - hp;
+                lp = b1 * y + a1 * lp;
+                float t = (float)(voice->age + i) / (float)sample_rate;
+                float gate = (t < 0.006f || (t > 0.012f && t < 0.02f) || (t > 0.026f && t < 0.034f)) ? 1.0f : 0.2f;
+                y = dsp_tanhf(lp * gate * 1.6f);
+                hp = b2 * y + a2 * hp;
+                lp = b3 * (y - hp) + a3 * lp;
+                x[i] = lp;
+            }
+            break;
+        }
+        case SYNTH_PM_HAT: {
+            float a0 = voice->hp_alpha, b0 = 1.0f - a0;
+            float a1 = voice->body_alpha, b1 = 1.0f - a1;
+            float a2 = voice->post_hp_alpha, b2 = 1.0f - a2;
+            float a3 = voice->post_lp_alpha, b3 = 1.0f - a3;
+            for (int i = 0; i < n; i++) {
+                hp = b0 * x[i] + a0 * hp;
+                float y = x[i] - hp;
+                lp = b1 * y + a1 * lp;
+                y = dsp_tanhf(lp * 1.6f);
+                hp = b2 * y + a2 * hp;
+                lp = b3 * (y - hp) + a3 * lp;
+                x[i] = lp;
+            }
+            break;
+        }
+        case SYNTH_PM_KICK:
+        case SYNTH_PM_TOM: {
+            float a1 = voice->body_alpha, b1 = 1.0f - a1;
+            fill_cutoff_coef(voice, s, n, sample_rate, type, s->coef, 1);
+            for (int i = 0; i < n; i++) {
+                float alpha = s->coef[i];
+                lp = (1.0f - alpha) * x[i] + alpha * lp;
+                float y = dsp_tanhf(lp * 1.6f);
+                lp = b1 * y + a1 * lp;
+                x[i] = lp;
+            }
+            break;
+        }
+        default: {
+            float a2 = voice->post_hp_alpha, b2 = 1.0f - a2;
+            float a3 = voice->post_lp_alpha, b3 = 1.0f - a3;
+            fill_cutoff_coef(voice, s, n, sample_rate, type, s->coef, 1);
+            for (int i = 0; i < n; i++) {
+                float alpha = s->coef[i];
+                lp = (1.0f - alpha) * x[i] + alpha * lp;
+                float y = dsp_tanhf(lp * 1.6f);
+                hp = b2 * y + a2 * hp;
+                lp = b3 * (y - hp) + a3 * lp;
+                x[i] = lp;
+            }
+            break;
+        }
+    }
+    voice->hp_state = hp;
+    voice->filter_state = lp;
+
+    // Tight, sci-fi edge: transient focus + light sample-hold.
+    bool drum = filter_chain(type) == CHAIN_PM_DRUM;
+    int hold = drum ? 2 : 3;
+    float crush_hold = cold->crush_hold;
+    int crush_count = cold->crush_count;
+    for (int i = 0; i < n; i++) {
+        float t_ms = (float)(voice->age + i) / (float)sample_rate * 1000.0f;
+        float transient = 1.0f + 0.45f * dsp_expf(-t_ms / 12.0f);
+        float y = x[i] * transient;
+        if (crush_count <= 0) {
+            crush_hold = y;
+            crush_count = hold;
+        }
+        crush_count--;
+        x[i] = crush_hold;
+    }
+    cold->crush_hold = crush_hold;
+    cold->crush_count = crush_count;
+    if (drum) {
+        for (int i = 0; i < n; i++) {
+            x[i] = floorf(x[i] * 128.0f) / 128.0f;
+        }
+    }
+}
+
+KERNEL_INLINE void flush_denormal_state(Voice *voice, SynthType type) {
+    voice->hp_state = dsp_flush_denormal(voice->hp_state);
+    voice->filter_state = dsp_flush_denormal(voice->filter_state);
+    voice->supersaw_lp = dsp_flush_denormal(voice->supersaw_lp);
+    voice->svf_lp = dsp_flush_denormal(voice->svf_lp);
+    voice->svf_bp = dsp_flush_denormal(voice->svf_bp);
+    if (has_delay(type)) {
+        voice->cold->comb_state = dsp_flush_denormal(voice->cold->comb_state);
+    }
+}
+
+// The body of every render kernel; `type` is a constant in each one.
+KERNEL_INLINE void render_kernel(Voice *voice, double sample_rate, float *mix_l, float *mix_r, int frames,
+                                 SynthType type) {
+    VoiceScratch s;
+    int done = 0;
+    while (done < frames && voice->active) {
+        int chunk = frames - done;
+        if (chunk > VOICE_BLOCK_FRAMES) {
+            chunk = VOICE_BLOCK_FRAMES;
+        }
+        int n = voice_control(voice, &s, chunk, sample_rate, noise_kind(type));
+        if (n <= 0) {
+            break;
+        }
+
+        render_osc(voice, &s, n, sample_rate, type);
+        if (filter_chain(type) == CHAIN_PLAIN) {
+            render_filters(voice, &s, n, sample_rate, type);
+        } else {
+            render_pm_filters(voice, &s, n, sample_rate, type);
+        }
+
+        float *x = s.sig;
+        if (voice->drive > 0.0f) {
+            float gain = 1.0f + fminf(8.0f, fmaxf(0.0f, voice->drive));
+            for (int i = 0; i < n; i++) {
+                x[i] = dsp_tanhf(x[i] * gain);
+            }
+        }
+
+        float *out_l = mix_l + done;
+        float *out_r = mix_r + done;
+        for (int i = 0; i < n; i++) {
+            float sample = x[i] * s.env[i] * s.amp[i];
+            out_l[i] += sample * (0.5f * (1.0f - s.pan[i]));
+            out_r[i] += sample * (0.5f * (1.0f + s.pan[i]));
+        }
+
+        voice->age += n;
+        done += n;
+        flush_denormal_state(voice, type);
+    }
+}
+
+#define KERNEL_DEFINE(type, noise, noise_hp, delay, chain)                                                  \
+    static void render_##type(Voice *voice, double sample_rate, float *mix_l, float *mix_r, int frames) { \
+        render_kernel(voice, sample_rate, mix_l, mix_r, frames, type);                                    \
+    }
+VOICE_KERNELS(KERNEL_DEFINE)
+
+#define KERNEL_ENTRY(type, noise, noise_hp, delay, chain) [type] = render_##type,
+static const VoiceKernel voice_kernels[] = {
+    VOICE_KERNELS(KERNEL_ENTRY)
+};
+
+static VoiceKernel kernel_for(SynthType type) {
+    return voice_kernels[type];
+}
+
+void voice_render_block(Voice *voice, double sample_rate, float *mix_l, float *mix_r, int frames) {
+    if (voice->active) {
+        voice->kernel(voice, sample_rate, mix_l, mix_r, frames);
+    }
+}
+
+// Voice banks
+//
+// Each lane runs the ordinary voice_control() pass (cheap for unmodulated
+// voices), and the per-frame envelope and phase are interleaved into
+// frame-major arrays so one dsp_f4 holds the same frame of every lane. The
+// oscillator, filter and drive stages then step all lanes at once; recursive
+// filters are serial in time but independent across voices, which is where
+// the lanes pay off. Unused lanes run on zeros and are never written back.
+
+typedef struct {
+    _Alignas(16) float env[VOICE_BLOCK_FRAMES * VOICE_BANK_LANES];
+    _Alignas(16) uint32_t phase[VOICE_BLOCK_FRAMES * VOICE_BANK_LANES];
+    _Alignas(16) float sig[VOICE_BLOCK_FRAMES * VOICE_BANK_LANES];
+    _Alignas(16) float coef[VOICE_BLOCK_FRAMES * VOICE_BANK_LANES];
+    _Alignas(16) float res[VOICE_BANK_LANES];
+    _Alignas(16) float amp[VOICE_BANK_LANES];
+    _Alignas(16) float accent[VOICE_BANK_LANES];
+    _Alignas(16) float drive[VOICE_BANK_LANES];
+    _Alignas(16) float lp[VOICE_BANK_LANES];
+    _Alignas(16) float bp[VOICE_BANK_LANES];
+} BankScratch;
+
+_Static_assert(VOICE_BANK_LANES == DSP_F4_LANES, "a bank frame is one dsp_f4");
+
+bool voice_bank_accepts(const Voice *voice) {
+    if (voice->mod_count > 0) {
+        return false;
+    }
+    switch (voice->type) {
+        case SYNTH_SINE:
+        case SYNTH_SAW:
+        case SYNTH_SQUARE:
+        case SYNTH_TRI:
+        case SYNTH_PULSE:
+        case SYNTH_ACID:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void bank_osc(SynthType type, BankScratch *b, int n) {
+    const uint32_t *ph = b->phase;
+    float *out = b->sig;
+
+    switch (type) {
+        case SYNTH_SINE:
+            for (int i = 0; i < n; i++) {
+                dsp_f4_store(out + i * 4, dsp_f4_sin_phase(ph + i * 4));
+            }
+            break;
+        case SYNTH_SAW:
+        case SYNTH_ACID:
+            for (int i = 0; i < n; i++) {
+                dsp_f4_store(out + i * 4, dsp_f4_saw_phase(ph + i * 4));
+            }
+            break;
+        case SYNTH_SQUARE:
+            for (int i = 0; i < n; i++) {
+                dsp_f4_store(out + i * 4, dsp_f4_pulse_phase(ph + i * 4, 0x80000000u));
+            }
+            break;
+        case SYNTH_TRI: {
+            dsp_f4 one = dsp_f4_set1(1.0f);
+            dsp_f4 two = dsp_f4_set1(2.0f);
+            for (int i = 0; i < n; i++) {
+                dsp_f4 saw = dsp_f4_saw_phase(ph + i * 4);
+                dsp_f4_store(out + i * 4, dsp_f4_sub(dsp_f4_mul(two, dsp_f4_abs(saw)), one));
+            }
+            break;
+        }
+        case SYNTH_PULSE:
+            for (int i = 0; i < n; i++) {
+                dsp_f4_store(out + i * 4, dsp_f4_pulse_phase(ph + i * 4, VOICE_PULSE_EDGE));
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void bank_acid_filter(BankScratch *b, int n) {
+    _Alignas(16) float q[VOICE_BANK_LANES];
+    _Alignas(16) float gain[VOICE_BANK_LANES];
+    for (int l = 0; l < VOICE_BANK_LANES; l++) {
+        float accent = b->accent[l];
+        float r = fminf(0.97f, b->res[l] + accent * 0.1f);
+        q[l] = fmaxf(0.1f, 1.0f - r);
+        gain[l] = 2.0f + accent * 0.55f;
+    }
+
+    dsp_f4 qv = dsp_f4_load(q);
+    dsp_f4 lp = dsp_f4_load(b->lp);
+    dsp_f4 bp = dsp_f4_load(b->bp);
+    for (int i = 0; i < n; i++) {
+        dsp_f4 f = dsp_f4_load(b->coef + i * 4);
+        // Two passes per sample (2x oversample approx).
+        dsp_f4 in = dsp_f4_load(b->sig + i * 4);
+        for (int pass = 0; pass < 2; pass++) {
+            lp = dsp_f4_add(lp, dsp_f4_mul(f, bp));
+            dsp_f4 hp = dsp_f4_sub(dsp_f4_sub(in, lp), dsp_f4_mul(qv, bp));
+            bp = dsp_f4_add(bp, dsp_f4_mul(f, hp));
+            in = lp;
+        }
+        dsp_f4_store(b->sig + i * 4, lp);
+    }
+    dsp_f4_store(b->lp, lp);
+    dsp_f4_store(b->bp, bp);
+
+    dsp_f4 g = dsp_f4_load(gain);
+    for (int i = 0; i < n; i++) {
+        dsp_f4 x = dsp_f4_load(b->sig + i * 4);
+        dsp_f4_store(b->sig + i * 4, dsp_f4_tanh(dsp_f4_mul(x, g)));
+    }
+}
+
+static void bank_lowpass(BankScratch *b, int n) {
+    dsp_f4 one = dsp_f4_set1(1.0f);
+    dsp_f4 state = dsp_f4_load(b->lp);
+    for (int i = 0; i < n; i++) {
+        dsp_f4 a = dsp_f4_load(b->coef + i * 4);
+        dsp_f4 beta = dsp_f4_sub(one, a);
+        state = dsp_f4_add(dsp_f4_mul(beta, dsp_f4_load(b->sig + i * 4)), dsp_f4_mul(a, state));
+        dsp_f4_store(b->sig + i * 4, state);
+    }
+    dsp_f4_store(b->lp, state);
+}
+
+static void bank_drive(BankScratch *b, int n) {
+    _Alignas(16) float gain[VOICE_BANK_LANES];
+    bool any = false;
+    for (int l = 0; l < VOICE_BANK_LANES; l++) {
+        gain[l] = 1.0f + fminf(8.0f, fmaxf(0.0f, b->drive[l]));
+        if (b->drive[l] > 0.0f) {
+            any = true;
+        }
+    }
+    if (!any) {
+        return;
+    }
+    dsp_f4 g = dsp_f4_load(gain);
+    dsp_f4 drive = dsp_f4_load(b->drive);
+    dsp_f4 zero = dsp_f4_set1(0.0f);
+    for (int i = 0; i < n; i++) {
+        dsp_f4 x = dsp_f4_load(b->sig + i * 4);
+        dsp_f4 driven = dsp_f4_tanh(dsp_f4_mul(x, g));
+        dsp_f4_store(b->sig + i * 4, dsp_f4_select_lt(zero, drive, driven, x));
+    }
+}
+
+void voice_bank_render(VoiceBank *bank, double sample_rate, int frames) {
+    VoiceScratch s;
+    BankScratch b;
+    if (frames > VOICE_BLOCK_FRAMES) {
+        frames = VOICE_BLOCK_FRAMES;
+    }
+    SynthType type = bank->voices[0]->type;
+
+    for (int l = 0; l < VOICE_BANK_LANES; l++) {
+        Voice *voice = (l < bank->lanes) ? bank->voices[l] : NULL;
+        int n = 0;
+        if (voice && voice->active) {
+            n = voice_control(voice, &s, frames, sample_rate, NOISE_NONE);
+            fill_cutoff_coef(voice, &s, n, sample_rate, type, b.coef + l, 4);
+        }
+        bank->frames[l] = n;
+        for (int i = 0; i < n; i++) {
+            b.env[i * 4 + l] = s.env[i];
+            b.phase[i * 4 + l] = s.phase[i];
+        }
+        for (int i = n; i < frames; i++) {
+            b.env[i * 4 + l] = 0.0f;
+            b.phase[i * 4 + l] = 0;
+            b.coef[i * 4 + l] = 0.0f;
+        }
+        // Without modulators, resonance and amp are constant.
+        b.res[l] = (n > 0) ? s.res[0] : 0.0f;
+        b.amp[l] = (n > 0) ? s.amp[0] : 0.0f;
+        b.accent[l] = voice ? voice->accent : 0.0f;
+        b.drive[l] = voice ? voice->drive : 0.0f;
+        b.lp[l] = voice ? ((type == SYNTH_ACID) ? voice->svf_lp : voice->filter_state) : 0.0f;
+        b.bp[l] = voice ? voice->svf_bp : 0.0f;
+    }
+
+    bank_osc(type, &b, frames);
+    if (type == SYNTH_ACID) {
+        bank_acid_filter(&b, frames);
+    } else {
+        bank_lowpass(&b, frames);
+    }
+    bank_drive(&b, frames);
+
+    dsp_f4 amp = dsp_f4_load(b.amp);
+    for (int i = 0; i < frames; i++) {
+        dsp_f4 x = dsp_f4_mul(dsp_f4_load(b.sig + i * 4), dsp_f4_load(b.env + i * 4));
+        dsp_f4_store(b.sig + i * 4, dsp_f4_mul(x, amp));
+    }
+    for (int l = 0; l < bank->lanes; l++) {
+        float *out = bank->out[l];
+        for (int i = 0; i < bank->frames[l]; i++) {
+            out[i] = b.sig[i * 4 + l];
+        }
+    }
+
+    // Lanes that finished mid-block have been released; note_on resets their
+    // filter state, so only voices still sounding take it back.
+    for (int l = 0; l < bank->lanes; l++) {
+        Voice *voice = bank->voices[l];
+        int n = bank->frames[l];
+        if (n <= 0) {
+            continue;
+        }
+        if (n == frames) {
+            if (type == SYNTH_ACID) {
+                voice->svf_lp = b.lp[l];
+                voice->svf_bp = b.bp[l];
+            } else {
+                voice->filter_state = b.lp[l];
+            }
+        }
+        voice->age += n;
+        flush_denormal_state(voice, type);
+    }
+}
+
+void voice_bank_mix_lane(const VoiceBank *bank, int lane, float *mix_l, float *mix_r) {
+    const float *out = bank->out[lane];
+    float pan = bank->voices[lane]->pan;
+    float gain_l = 0.5f * (1.0f - pan);
+    float gain_r = 0.5f * (1.0f + pan);
+    for (int i = 0; i < bank->frames[lane]; i++) {
+        mix_l[i] += out[i] * gain_l;
+        mix_r[i] += out[i] * gain_r;
+    }
+}
@@ -0,0 +1,206 @@
+#ifndef VOICE_H
+#define VOICE_H
+
+#include "delay_pool.h"
+#include "dsl.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// A single synth voice: oscillator, envelope, modulation and filters.
+
+#define COMB_MAX_SAMPLES DELAY_POOL_MAX_LEN
+
+// Control rate: slowly moving per-voice values (modulators, supersaw detune,
+// filter coefficients) are recomputed once per control block and ramped in
+// between. The block length is set per program (`control_block`); this is the
+// default.
+#define VOICE_CONTROL_FRAMES 32
+
+#define VOICE_MOD_DESTS (MOD_DEST_PITCH + 1)
+
+// Supersaw unison: detuned saws with their own phase accumulators. The
+// detune LFOs and pitch ratios are refreshed at control rate.
+#define SUPERSAW_VOICES 10
+
+typedef enum {
+    ENV_ATTACK,
+    ENV_DECAY,
+    ENV_SUSTAIN,
+    ENV_RELEASE,
+    ENV_OFF
+} EnvStage;
+
+// State that only some voices render with: comb and PM delay lines, mods
+// and their per-mod state, the supersaw unison. Each voice points at its own
+// record in a separate array, so the render loop only pulls it in for voices
+// that need it.
+struct VoiceTemplate;
+
+typedef struct {
+    const struct VoiceTemplate *tmpl; // the template the note started from
+    float amp_scale; // the note's gain on the synth's level: amp_scale, make-up and accent
+    // Comb and PM voices check a comb_len-sample line out of `delays` at
+    // note-on and keep it until the slot's next note-on, so rendering never
+    // touches the shared pool; other voices hold none.
+    float *comb_buf;
+    DelayPool *delays;
+    int comb_idx;
+    int comb_len;
+    int comb_fresh; // samples until the line has been written once and stops reading as silence
+    float comb_feedback;
+    float comb_damp;
+    float comb_state;
+    float crush_hold;
+    int crush_count;
+    int mod_countdown;
+    uint32_t mod_audio_mask; // bit m set: mods[m] is evaluated every sample
+    // Control-rate mod destinations (amp and pitch as gain and frequency
+    // ratio, the rest as sums) and their per-sample ramps.
+    float mod_dest[VOICE_MOD_DESTS];
+    float mod_dest_step[VOICE_MOD_DESTS];
+    ModDef mods[32];
+    uint32_t mod_phase[32];
+    float mod_hold[32];
+    float mod_state[32];
+    // Per-mod phase increment, lag coefficient and slew limit, per sample for
+    // audio-rate mods and per control block for the rest.
+    uint32_t mod_inc[32];
+    float mod_lag[32];
+    float mod_slew[32];
+    int unison_countdown;
+    float detune_rate;
+    float detune_depth;
+    uint32_t unison_phase[SUPERSAW_VOICES];
+    uint32_t unison_lfo_phase[SUPERSAW_VOICES];
+    float unison_ratio[SUPERSAW_VOICES];
+} VoiceCold;
+
+typedef struct Voice Voice;
+typedef void (*VoiceKernel)(Voice *voice, double sample_rate, float *mix_l, float *mix_r, int frames);
+
+// The state every voice touches while rendering, roughly envelope and phase,
+// then filters, then output. Voices are cache-line aligned so pooled voices
+// never share a line.
+struct Voice {
+    _Alignas(64) bool active;
+    SynthType type;
+    EnvStage stage;
+    float env;
+    float atk_inc;
+    float dec_inc;
+    float rel_inc;
+    float sus;
+    int gate_samples;
+    float freq;
+    float glide_step;
+    int glide_samples;
+    uint32_t phase; // fixed-point cycle fraction, see dsp_phase_inc
+    float pitch_env;
+    float pitch_decay;
+    int age;
+    uint32_t rng;
+    int mod_count;
+    int control_frames;
+
+    // Filter coefficients. Fixed-frequency filters are set up at note-on;
+    // cutoff_coef tracks the cutoff at control rate and ramps linearly
+    // between control points.
+    float hp_alpha;
+    float body_alpha;
+    float post_hp_alpha;
+    float post_lp_alpha;
+    float cutoff_coef;
+    float cutoff_coef_step;
+    int coef_countdown;
+    float cutoff;
+    float res;
+    float accent;
+    float hp_state;
+    float filter_state;
+    float supersaw_lp;
+    float svf_lp;
+    float svf_bp;
+    float amp;
+
+    float pan;
+    float drive;
+    VoiceKernel kernel; // renders this voice's synth type, set at note-on
+    VoiceCold *cold;
+};
+
+// Voices render in chunks of at most this many frames; longer spans are split.
+#define VOICE_BLOCK_FRAMES 256
+
+// Everything note-on takes from a SynthDef, worked out once per program load
+// for one sample rate and control block. Starting a note copies `voice` and
+// the mod setup, then fills in the per-note pitch, gate, level and accent.
+typedef struct VoiceTemplate {
+    Voice voice; // a fresh note's render state, before the per-note fields
+    double sample_rate;
+    float fixed_freq; // drum pitch that ignores the note, 0 if none
+    float amp_gain;   // type make-up gain on top of the note's amp_scale
+    // Accented notes: extra gain and the faster decay they switch to.
+    float accent_gain;
+    float accent_dec_inc;
+    float accent_rel_inc;
+    int comb_len; // delay length for fixed-pitch PM drums, 0 to follow the note
+    float comb_feedback;
+    float comb_damp;
+    float detune_rate;
+    float detune_depth;
+    uint32_t unison_phase[SUPERSAW_VOICES];
+    uint32_t unison_lfo_phase[SUPERSAW_VOICES];
+    uint32_t mod_audio_mask;
+    ModDef mods[32];
+    uint32_t mod_inc[32];
+    float mod_lag[32];
+    float mod_slew[32];
+} VoiceTemplate;
+
+// `control_frames` is the control block length, or 0 for the default.
+void voice_template_init(VoiceTemplate *tmpl, const SynthDef *synth, double sample_rate, int control_frames);
+
+// Starts a note on `voice` from its synth's template. Voices keep their
+// previous pitch (for glides) and noise state across notes.
+void voice_note_on(Voice *voice,
+                   const VoiceTemplate *tmpl,
+                   float freq,
+                   int gate_samples,
+                   float amp_scale,
+                   int glide_samples,
+                   int accent);
+
+// Sends the voice into a release that reaches silence after `frames`
+// samples, whatever its stage and level. Used when a voice is stolen.
+void voice_fade_out(Voice *voice, int frames);
+
+// Renders `frames` samples of an active voice and adds them, panned, into the
+// stereo accumulators. Stops early (and clears `active`) when the release
+// stage finishes. Inactive voices are a no-op.
+void voice_render_block(Voice *voice, double sample_rate, float *mix_l, float *mix_r, int frames);
+
+// Voice banks render up to VOICE_BANK_LANES voices of the same synth type in
+// lockstep, one SIMD lane per voice (see dsp_simd.h). Envelopes and phases
+// still advance per voice; oscillators, filters and drive run across lanes.
+// A banked voice produces exactly the samples it would produce on its own.
+#define VOICE_BANK_LANES 4
+
+typedef struct {
+    Voice *voices[VOICE_BANK_LANES];
+    int lanes;
+    int frames[VOICE_BANK_LANES]; // frames each lane rendered before stopping
+    float out[VOICE_BANK_LANES][VOICE_BLOCK_FRAMES];
+} VoiceBank;
+
+// Unmodulated sine, saw, square, tri, pulse and acid voices can be banked.
+bool voice_bank_accepts(const Voice *voice);
+
+// Renders `frames` (at most VOICE_BLOCK_FRAMES) samples of every lane into
+// bank->out. All lanes must share a synth type.
+void voice_bank_render(VoiceBank *bank, double sample_rate, int frames);
+
+// Adds one lane's rendered output, panned, into the stereo accumulators.
+void voice_bank_mix_lane(const VoiceBank *bank, int lane, float *mix_l, float *mix_r);
+
+#endif
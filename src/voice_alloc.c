@@ -0,0 +1,197 @@
+#include "voice_alloc.h"
+
+#include <stdlib.h>
+
+static void list_append(VoiceAllocator *alloc, int v) {
+    alloc->prev[v] = alloc->tail;
+    alloc->next[v] = -1;
+    if (alloc->tail >= 0) {
+        alloc->next[alloc->tail] = v;
+    } else {
+        alloc->head = v;
+    }
+    alloc->tail = v;
+}
+
+static void list_remove(VoiceAllocator *alloc, int v) {
+    int p = alloc->prev[v];
+    int n = alloc->next[v];
+    if (p >= 0) {
+        alloc->next[p] = n;
+    } else {
+        alloc->head = n;
+    }
+    if (n >= 0) {
+        alloc->prev[n] = p;
+    } else {
+        alloc->tail = p;
+    }
+}
+
+int voice_alloc_init(VoiceAllocator *alloc, int polyphony) {
+    int slots = voice_alloc_slots(polyphony);
+    alloc->slots = slots;
+    alloc->polyphony = polyphony;
+    alloc->free_voices = (int *)malloc(sizeof(int) * (size_t)slots);
+    alloc->prev = (int *)malloc(sizeof(int) * (size_t)slots);
+    alloc->next = (int *)malloc(sizeof(int) * (size_t)slots);
+    alloc->track = (int *)malloc(sizeof(int) * (size_t)slots);
+    alloc->fading = (bool *)malloc(sizeof(bool) * (size_t)slots);
+    if (!alloc->free_voices || !alloc->prev || !alloc->next || !alloc->track || !alloc->fading) {
+        voice_alloc_free(alloc);
+        return 0;
+    }
+    voice_alloc_reset(alloc);
+    return 1;
+}
+
+void voice_alloc_free(VoiceAllocator *alloc) {
+    free(alloc->free_voices);
+    free(alloc->prev);
+    free(alloc->next);
+    free(alloc->track);
+    free(alloc->fading);
+    alloc->free_voices = NULL;
+    alloc->prev = NULL;
+    alloc->next = NULL;
+    alloc->track = NULL;
+    alloc->fading = NULL;
+    alloc->slots = 0;
+    alloc->polyphony = 0;
+    alloc->free_count = 0;
+    alloc->head = -1;
+    alloc->tail = -1;
+}
+
+void voice_alloc_reset(VoiceAllocator *alloc) {
+    int slots = alloc->slots;
+    alloc->held = 0;
+    // Pushed in reverse so notes start on the lowest slots first.
+    for (int i = 0; i < slots; i++) {
+        alloc->free_voices[i] = slots - 1 - i;
+        alloc->track[i] = -1;
+        alloc->fading[i] = false;
+    }
+    alloc->free_count = slots;
+    alloc->head = -1;
+    alloc->tail = -1;
+    alloc->stats.allocs = 0;
+    alloc->stats.steals = 0;
+    alloc->stats.drops = 0;
+}
+
+// Walks the sounding voices oldest first and returns the one `policy` would
+// give up, falling back to the oldest. Voices already fading are skipped.
+static int pick_victim(const VoiceAllocator *alloc, const Voice *voices, int track, StealPolicy policy) {
+    int oldest = -1;
+    int quietest = -1;
+    float quietest_level = 0.0f;
+    for (int v = alloc->head; v >= 0; v = alloc->next[v]) {
+        if (alloc->fading[v]) {
+            continue;
+        }
+        if (oldest < 0) {
+            oldest = v;
+            if (policy == STEAL_OLDEST) {
+                break;
+            }
+        }
+        if (policy == STEAL_SAME_TRACK && alloc->track[v] == track) {
+            return v;
+        }
+        if (policy == STEAL_RELEASE && voices[v].stage == ENV_RELEASE) {
+            return v;
+        }
+        if (policy == STEAL_QUIETEST) {
+            float level = voices[v].env * voices[v].amp;
+            if (quietest < 0 || level < quietest_level) {
+                quietest = v;
+                quietest_level = level;
+            }
+        }
+    }
+    return (quietest >= 0) ? quietest : oldest;
+}
+
+int voice_alloc_acquire(VoiceAllocator *alloc, Voice *voices, int track, StealPolicy policy, double sample_rate) {
+    int slot = -1;
+    if (alloc->held < alloc->polyphony && alloc->free_count > 0) {
+        slot = alloc->free_voices[--alloc->free_count];
+    } else if (alloc->held < alloc->polyphony) {
+        // Voices fading out (after a steal, a program switch or
+        // voice_alloc_fade_all) fill every free slot: the oldest of them is
+        // cut. Held voices, such as a drone that outlived a switch, are left
+        // to the steal below.
+        for (int v = alloc->head; v >= 0; v = alloc->next[v]) {
+            if (alloc->fading[v]) {
+                slot = v;
+                break;
+            }
+        }
+        if (slot >= 0) {
+            list_remove(alloc, slot);
+        }
+    }
+    if (slot < 0) {
+        int victim = (policy == STEAL_NONE) ? -1 : pick_victim(alloc, voices, track, policy);
+        if (victim < 0) {
+            alloc->stats.drops++;
+            return -1;
+        }
+        alloc->stats.steals++;
+        alloc->held--;
+        if (alloc->free_count > 0) {
+            voice_fade_out(&voices[victim], (int)(sample_rate * VOICE_STEAL_FADE_SECONDS));
+            alloc->fading[victim] = true;
+            slot = alloc->free_voices[--alloc->free_count];
+        } else {
+            list_remove(alloc, victim);
+            slot = victim;
+        }
+    }
+    alloc->track[slot] = track;
+    alloc->fading[slot] = false;
+    list_append(alloc, slot);
+    alloc->held++;
+    alloc->stats.allocs++;
+    return slot;
+}
+
+void voice_alloc_fade_all(VoiceAllocator *alloc, Voice *voices, int frames) {
+    for (int v = alloc->head; v >= 0; v = alloc->next[v]) {
+        if (!alloc->fading[v]) {
+            voice_fade_out(&voices[v], frames);
+            alloc->fading[v] = true;
+        }
+    }
+    alloc->held = 0;
+}
+
+void voice_alloc_fade(VoiceAllocator *alloc, Voice *voices, int slot, int frames) {
+    if (alloc->fading[slot]) {
+        return;
+    }
+    voice_fade_out(&voices[slot], frames);
+    alloc->fading[slot] = true;
+    alloc->held--;
+}
+
+void voice_alloc_release(VoiceAllocator *alloc, int slot) {
+    list_remove(alloc, slot);
+    if (!alloc->fading[slot]) {
+        alloc->held--;
+    }
+    alloc->fading[slot] = false;
+    alloc->free_voices[alloc->free_count++] = slot;
+}
+
+void voice_alloc_collect(VoiceAllocator *alloc, const Voice *voices) {
+    int v = alloc->head;
+    while (v >= 0) {
+        int next = alloc->next[v];
+        if (!voices[v].active) {
+            voice_alloc_release(alloc, v);
+        }
+        v = next;
+    }
+}
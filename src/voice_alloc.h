@@ -0,0 +1,76 @@
+#ifndef VOICE_ALLOC_H
+#define VOICE_ALLOC_H
+
+#include "dsl.h"
+#include "voice.h"
+
+#include <stdbool.h>
+
+// Voice allocation over an array of voice slots. Free voices sit on a stack
+// and sounding voices on a list in start order, so starting and finishing a
+// note are O(1); only stealing searches the list. The list doubles as the
+// active-voice list the engine renders from.
+//
+// `polyphony` voices can be held at once. A stolen voice fades out over
+// VOICE_STEAL_FADE_SECONDS while the new note starts on one of the spare
+// VOICE_STEAL_SLOTS; if every spare is still busy fading, the stolen voice is
+// cut and reused directly.
+
+#define VOICE_STEAL_SLOTS 4
+#define VOICE_STEAL_FADE_SECONDS 0.002
+
+typedef struct {
+    unsigned long long allocs; // notes started
+    unsigned long long steals; // notes that took over a sounding voice
+    unsigned long long drops;  // notes not played for lack of a voice
+} VoiceAllocStats;
+
+typedef struct {
+    int slots;
+    int polyphony;
+    int held; // sounding voices that are not fading out after a steal
+    int *free_voices;
+    int free_count;
+    int *prev;
+    int *next;
+    int head; // oldest sounding voice, -1 if none
+    int tail;
+    int *track; // owning track, -1 for drones
+    bool *fading;
+    VoiceAllocStats stats;
+} VoiceAllocator;
+
+// Sizes the allocator for `polyphony` held voices, which needs
+// voice_alloc_slots(polyphony) voice slots. Allocates; returns 0 when out of
+// memory. The allocator starts reset.
+int voice_alloc_init(VoiceAllocator *alloc, int polyphony);
+void voice_alloc_free(VoiceAllocator *alloc);
+
+static inline int voice_alloc_slots(int polyphony) {
+    return polyphony + VOICE_STEAL_SLOTS;
+}
+
+// Marks every slot free and clears the stats.
+void voice_alloc_reset(VoiceAllocator *alloc);
+
+// Picks a voice for a new note on `track`, stealing one by `policy` if all
+// are held. Returns the slot to start the note on, or -1 if the note is
+// dropped. The caller must start the note on the returned slot.
+int voice_alloc_acquire(VoiceAllocator *alloc, Voice *voices, int track, StealPolicy policy, double sample_rate);
+
+// Fades out every sounding voice over `frames` samples. Fading voices no
+// longer count as held, and new notes cut the oldest of them once no slot is
+// free.
+void voice_alloc_fade_all(VoiceAllocator *alloc, Voice *voices, int frames);
+
+// Fades out one sounding voice the same way. A voice already fading is left
+// alone.
+void voice_alloc_fade(VoiceAllocator *alloc, Voice *voices, int slot, int frames);
+
+// Returns a voice that has stopped sounding to the free stack.
+void voice_alloc_release(VoiceAllocator *alloc, int slot);
+
+// Calls voice_alloc_release for every listed voice that is no longer active.
+void voice_alloc_collect(VoiceAllocator *alloc, const Voice *voices);
+
+#endif
@@ -0,0 +1,347 @@
+#include "wav_writer.h"
+#include "dsp_simd.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define WAV_FORMAT_PCM 1
+#define WAV_FORMAT_IEEE_FLOAT 3
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE
+#define WAV_HEADER_MAX_BYTES 128
+// Holds the ds64 chunk of an RF64 file: RIFF size, data size, sample count
+// and an empty table.
+#define WAV_DS64_BYTES 28
+#define WAV_UNKNOWN_SIZE 0xFFFFFFFFu
+
+struct WavWriter {
+    FILE *file;
+    int sample_rate;
+    int channels;
+    WavFormat format;
+    int sample_bytes;
+    int stream; // header sizes stay unknown; the file is not ours to close
+    uint64_t frames_written;
+    unsigned char *buffer; // WAV_WRITE_BUFFER_BYTES
+    size_t buffered;
+};
+
+static void put_u16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v & 0xFF);
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v & 0xFF);
+    p[1] = (uint8_t)((v >> 8) & 0xFF);
+    p[2] = (uint8_t)((v >> 16) & 0xFF);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static void put_u64(uint8_t *p, uint64_t v) {
+    put_u32(p, (uint32_t)(v & 0xFFFFFFFFu));
+    put_u32(p + 4, (uint32_t)(v >> 32));
+}
+
+static int sample_bytes(WavFormat format) {
+    switch (format) {
+        case WAV_PCM16:
+            return 2;
+        case WAV_PCM24:
+            return 3;
+        default:
+            return 4;
+    }
+}
+
+// Builds the header for `frames` frames and returns its length, which depends
+// only on the format and channel count. With unknown_length every size field
+// is all ones, for streams.
+static size_t build_header(uint8_t *h, const WavWriter *w, uint64_t frames, bool unknown_length) {
+    bool is_float = w->format == WAV_FLOAT32;
+    bool extensible = w->channels > 2;
+    uint32_t fmt_bytes = extensible ? 40 : (is_float ? 18 : 16);
+    size_t len = 12 + 8 + WAV_DS64_BYTES + 8 + fmt_bytes + (is_float ? 12 : 0) + 8;
+
+    uint32_t block_align = (uint32_t)w->channels * (uint32_t)w->sample_bytes;
+    uint64_t data_bytes = frames * block_align;
+    uint64_t riff_bytes = len - 8 + data_bytes;
+    bool rf64 = !unknown_length && riff_bytes > 0xFFFFFFFFull;
+    bool big = rf64 || unknown_length;
+
+    uint8_t *p = h;
+    memcpy(p, rf64 ? "RF64" : "RIFF", 4);
+    put_u32(p + 4, big ? WAV_UNKNOWN_SIZE : (uint32_t)riff_bytes);
+    memcpy(p + 8, "WAVE", 4);
+    p += 12;
+
+    memcpy(p, rf64 ? "ds64" : "JUNK", 4);
+    put_u32(p + 4, WAV_DS64_BYTES);
+    memset(p + 8, 0, WAV_DS64_BYTES);
+    if (rf64) {
+        put_u64(p + 8, riff_bytes);
+        put_u64(p + 16, data_bytes);
+        put_u64(p + 24, frames);
+    }
+    p += 8 + WAV_DS64_BYTES;
+
+    uint16_t tag = is_float ? WAV_FORMAT_IEEE_FLOAT : WAV_FORMAT_PCM;
+    uint16_t bits = (uint16_t)(w->sample_bytes * 8);
+    memcpy(p, "fmt ", 4);
+    put_u32(p + 4, fmt_bytes);
+    put_u16(p + 8, extensible ? WAV_FORMAT_EXTENSIBLE : tag);
+    put_u16(p + 10, (uint16_t)w->channels);
+    put_u32(p + 12, (uint32_t)w->sample_rate);
+    put_u32(p + 16, (uint32_t)w->sample_rate * block_align);
+    put_u16(p + 20, (uint16_t)block_align);
+    put_u16(p + 22, bits);
+    if (fmt_bytes >= 18) {
+        put_u16(p + 24, extensible ? 22 : 0);
+    }
+    if (extensible) {
+        // Valid bits, no speaker assignment, then the sub-format GUID.
+        static const uint8_t guid_tail[14] = {0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80,
+                                              0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+        put_u16(p + 26, bits);
+        put_u32(p + 28, 0);
+        put_u16(p + 32, tag);
+        memcpy(p + 34, guid_tail, sizeof(guid_tail));
+    }
+    p += 8 + fmt_bytes;
+
+    // Non-PCM formats carry a fact chunk with the per-channel frame count.
+    if (is_float) {
+        memcpy(p, "fact", 4);
+        put_u32(p + 4, 4);
+        put_u32(p + 8, (big || frames > 0xFFFFFFFFull) ? WAV_UNKNOWN_SIZE : (uint32_t)frames);
+        p += 12;
+    }
+
+    memcpy(p, "data", 4);
+    put_u32(p + 4, big ? WAV_UNKNOWN_SIZE : (uint32_t)data_bytes);
+    return len;
+}
+
+// Integer scale and clip limits per format. The upper limit of 32-bit PCM is
+// the largest float below 2^31.
+static void int_range(WavFormat format, float *scale, float *lo, float *hi) {
+    switch (format) {
+        case WAV_PCM16:
+            *scale = 32767.0f;
+            *lo = -32768.0f;
+            *hi = 32767.0f;
+            break;
+        case WAV_PCM24:
+            *scale = 8388607.0f;
+            *lo = -8388608.0f;
+            *hi = 8388607.0f;
+            break;
+        default:
+            *scale = 2147483648.0f;
+            *lo = -2147483648.0f;
+            *hi = 2147483520.0f;
+            break;
+    }
+}
+
+// Scales, clips and rounds to nearest. The SSE2 path clips in float before
+// converting as well, so both paths give the same integers.
+static void to_int32(const float *in, int32_t *out, size_t count, WavFormat format) {
+    float scale, lo, hi;
+    int_range(format, &scale, &lo, &hi);
+    size_t i = 0;
+#if defined(DSP_SIMD_SSE2)
+    __m128 vscale = _mm_set1_ps(scale);
+    __m128 vlo = _mm_set1_ps(lo);
+    __m128 vhi = _mm_set1_ps(hi);
+    for (; i + 4 <= count; i += 4) {
+        __m128 v = _mm_mul_ps(_mm_loadu_ps(in + i), vscale);
+        v = _mm_min_ps(_mm_max_ps(v, vlo), vhi);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_cvtps_epi32(v));
+    }
+#endif
+    for (; i < count; i++) {
+        float v = fminf(fmaxf(in[i] * scale, lo), hi);
+        out[i] = (int32_t)lrintf(v);
+    }
+}
+
+#define CONVERT_BLOCK 256
+
+// Converts `count` samples to the file's little-endian sample format.
+static void convert(const float *in, unsigned char *out, size_t count, WavFormat format) {
+    if (format == WAV_FLOAT32) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        for (size_t i = 0; i < count; i++) {
+            uint32_t bits;
+            memcpy(&bits, &in[i], 4);
+            put_u32(out + 4 * i, bits);
+        }
+#else
+        memcpy(out, in, count * sizeof(float));
+#endif
+        return;
+    }
+    int32_t ints[CONVERT_BLOCK];
+    for (size_t start = 0; start < count; start += CONVERT_BLOCK) {
+        size_t n = count - start < CONVERT_BLOCK ? count - start : CONVERT_BLOCK;
+        to_int32(in + start, ints, n, format);
+        unsigned char *dst = out + start * (size_t)sample_bytes(format);
+        switch (format) {
+            case WAV_PCM16:
+                for (size_t i = 0; i < n; i++) {
+                    put_u16(dst + 2 * i, (uint16_t)ints[i]);
+                }
+                break;
+            case WAV_PCM24:
+                for (size_t i = 0; i < n; i++) {
+                    uint32_t v = (uint32_t)ints[i];
+                    dst[3 * i] = (uint8_t)(v & 0xFF);
+                    dst[3 * i + 1] = (uint8_t)((v >> 8) & 0xFF);
+                    dst[3 * i + 2] = (uint8_t)((v >> 16) & 0xFF);
+                }
+                break;
+            default:
+                for (size_t i = 0; i < n; i++) {
+                    put_u32(dst + 4 * i, (uint32_t)ints[i]);
+                }
+                break;
+        }
+    }
+}
+
+static int flush_buffer(WavWriter *writer) {
+    if (writer->buffered == 0) {
+        return 1;
+    }
+    size_t n = fwrite(writer->buffer, 1, writer->buffered, writer->file);
+    int ok = n == writer->buffered;
+    writer->buffered = 0;
+    return ok;
+}
+
+static WavWriter *new_writer(FILE *file, int sample_rate, int channels, WavFormat format, char *error, size_t error_len) {
+    WavWriter *writer = (WavWriter *)calloc(1, sizeof(WavWriter));
+    unsigned char *buffer = (unsigned char *)aligned_alloc(64, WAV_WRITE_BUFFER_BYTES);
+    if (!writer || !buffer) {
+        free(writer);
+        free(buffer);
+        snprintf(error, error_len, "Out of memory");
+        return NULL;
+    }
+    writer->file = file;
+    writer->sample_rate = sample_rate;
+    writer->channels = channels;
+    writer->format = format;
+    writer->sample_bytes = sample_bytes(format);
+    writer->buffer = buffer;
+    // Everything goes out through `buffer`, so stdio needn't copy it again.
+    // Only takes effect before the first write to the stream.
+    setvbuf(file, NULL, _IONBF, 0);
+    return writer;
+}
+
+static void free_writer(WavWriter *writer) {
+    free(writer->buffer);
+    free(writer);
+}
+
+WavWriter *wav_writer_open(const char *path, int sample_rate, int channels, WavFormat format, char *error, size_t error_len) {
+    if (!path || sample_rate <= 0 || channels <= 0) {
+        snprintf(error, error_len, "Invalid output path");
+        return NULL;
+    }
+    // A file sharing its data with another name, such as a render cache
+    // entry, is replaced rather than rewritten in place.
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISREG(st.st_mode) && st.st_nlink > 1) {
+        unlink(path);
+    }
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        snprintf(error, error_len, "Failed to create output file");
+        return NULL;
+    }
+    WavWriter *writer = new_writer(file, sample_rate, channels, format, error, error_len);
+    if (!writer) {
+        fclose(file);
+        return NULL;
+    }
+
+    uint8_t header[WAV_HEADER_MAX_BYTES];
+    size_t len = build_header(header, writer, 0, false);
+    if (fwrite(header, 1, len, file) != len) {
+        fclose(file);
+        free_writer(writer);
+        snprintf(error, error_len, "Failed to create output file");
+        return NULL;
+    }
+    return writer;
+}
+
+WavWriter *wav_writer_open_stream(FILE *file, int sample_rate, int channels, WavFormat format, int raw, char *error, size_t error_len) {
+    if (!file || sample_rate <= 0 || channels <= 0) {
+        snprintf(error, error_len, "Invalid output stream");
+        return NULL;
+    }
+    WavWriter *writer = new_writer(file, sample_rate, channels, format, error, error_len);
+    if (!writer) {
+        return NULL;
+    }
+    writer->stream = 1;
+    if (!raw) {
+        writer->buffered = build_header(writer->buffer, writer, 0, true);
+    }
+    return writer;
+}
+
+int wav_writer_write(WavWriter *writer, const float *interleaved, int frames) {
+    if (!writer || frames <= 0) {
+        return 1;
+    }
+    size_t count = (size_t)frames * (size_t)writer->channels;
+    size_t bytes = (size_t)writer->sample_bytes;
+    size_t done = 0;
+    while (done < count) {
+        size_t room = (WAV_WRITE_BUFFER_BYTES - writer->buffered) / bytes;
+        if (room == 0) {
+            if (!flush_buffer(writer)) {
+                return 0;
+            }
+            continue;
+        }
+        size_t n = count - done < room ? count - done : room;
+        convert(interleaved + done, writer->buffer + writer->buffered, n, writer->format);
+        writer->buffered += n * bytes;
+        done += n;
+    }
+    writer->frames_written += (uint64_t)frames;
+    return 1;
+}
+
+int wav_writer_close(WavWriter *writer) {
+    if (!writer) {
+        return 1;
+    }
+    int ok = flush_buffer(writer);
+    if (writer->stream) {
+        ok &= fflush(writer->file) == 0;
+        free_writer(writer);
+        return ok;
+    }
+    uint8_t header[WAV_HEADER_MAX_BYTES];
+    size_t len = build_header(header, writer, writer->frames_written, false);
+    if (fseek(writer->file, 0, SEEK_SET) != 0 || fwrite(header, 1, len, writer->file) != len) {
+        ok = 0;
+    }
+    if (fclose(writer->file) != 0) {
+        ok = 0;
+    }
+    free_writer(writer);
+    return ok;
+}
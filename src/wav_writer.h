@@ -0,0 +1,41 @@
+#ifndef WAV_WRITER_H
+#define WAV_WRITER_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Streaming WAV writer. Samples arrive as interleaved floats and are stored
+// as 32-bit float or 16/24/32-bit integer PCM, converted straight into a
+// WAV_WRITE_BUFFER_BYTES buffer that goes to the file in one write when
+// full. The header is written with placeholder sizes on open and patched on
+// close; files whose data outgrows the 4 GB RIFF limit become RF64, using
+// the space a JUNK chunk holds for that in every header.
+
+#define WAV_WRITE_BUFFER_BYTES (1 << 20)
+
+typedef enum {
+    WAV_FLOAT32,
+    WAV_PCM16,
+    WAV_PCM24,
+    WAV_PCM32
+} WavFormat;
+
+typedef struct WavWriter WavWriter;
+
+// Integer formats map [-1, 1] to the full range with round-to-nearest, so
+// audio the engine already quantized to 16 or 24 bits converts exactly;
+// samples beyond full scale clip.
+WavWriter *wav_writer_open(const char *path, int sample_rate, int channels, WavFormat format, char *error, size_t error_len);
+
+// Writes to an already open stream that may not seek, such as a pipe: either
+// a WAV header whose sizes say "unknown length" (all ones), or with raw set,
+// bare little-endian samples. Closing flushes the stream but leaves it open.
+WavWriter *wav_writer_open_stream(FILE *file, int sample_rate, int channels, WavFormat format, int raw, char *error, size_t error_len);
+
+// Appends `frames` interleaved frames. Returns 0 on I/O error.
+int wav_writer_write(WavWriter *writer, const float *interleaved, int frames);
+
+// Finalizes the header and closes the file. Returns 0 on I/O error.
+int wav_writer_close(WavWriter *writer);
+
+#endif